@@ -37,10 +37,12 @@
 #include <unistd.h>     
 #include <sys/stat.h>
 #include <errno.h>
+#include <memory>
 #include <seqan/modifier.h>
 #include <seqan/bed_io.h>
 
 #include "parse_alignments.h"
+#include "trunc_count_index.h"
 #include "hmm_1.h"
 #include "prepro_mle.h"
 #include "call_sites_replicates.h"
@@ -89,7 +91,7 @@ bool loadIntervals(AppOptions &options, TStore &store)
         appendValue(options.intervals_contigIds, contigId);
         // extract positions
         unsigned i1 = 0;
-        unsigned i2 = length(store.contigStore[contigId].seq);
+        unsigned i2 = contigLength(store, contigId);
         if (j < length(buffer))
         {
             CharString i1_str;
@@ -118,13 +120,13 @@ bool loadIntervals(AppOptions &options, TStore &store)
 
     if (empty(options.intervals_str))   // use all reference contigs
     {
-        for (unsigned contigId = 0; contigId < length(store.contigStore); ++contigId)
+        for (unsigned contigId = 0; contigId < length(store.contigNameStore); ++contigId)
         {
             appendValue(options.intervals_contigIds, contigId);
             CharString contigName = store.contigNameStore[contigId];
 
             unsigned i1 = 0;
-            unsigned i2 = length(store.contigStore[contigId].seq);
+            unsigned i2 = contigLength(store, contigId);
             if (options.verbosity >= 2)  std::cout << "contigName: " << contigName << " i1: " << i1 << " i2: " << i2 << std::endl;
 
             String<unsigned> interval;
@@ -167,7 +169,7 @@ bool loadApplyChrs(AppOptions &options, TStore &store)
 
     if (empty(options.applyChr_str))   // use all reference contigs
     {
-        for (unsigned contigId = 0; contigId < length(store.contigStore); ++contigId)
+        for (unsigned contigId = 0; contigId < length(store.contigNameStore); ++contigId)
         {
             if (options.verbosity >= 2) std::cout << "contigName: " << store.contigNameStore[contigId] << std::endl;
             appendValue(options.applyChr_contigIds, contigId);
@@ -207,14 +209,15 @@ int loadObservations(TContigObservations &contigObservationsF, TContigObservatio
         return 2; 
     }
 
-    resize(contigObservationsF.truncCounts, length(store.contigStore[contigId].seq), 0, Exact());
-    resize(contigObservationsR.truncCounts, length(store.contigStore[contigId].seq), 0, Exact());
+    unsigned contigLen = contigLength(store, contigId);
+    init(contigObservationsF, contigLen);
+    init(contigObservationsR, contigLen);
 
-    if (!parse_bamRegion(contigObservationsF, contigObservationsR, inFile, baiIndex, rID, options))
+    String<unsigned> outsideR;
+    bool hasAlignments = false;
+    if (!parse_bamRegion(contigObservationsF, contigObservationsR, outsideR, hasAlignments, inFile, baiIndex, rID, 0, contigLen, options) || !hasAlignments)
         return 2;
-
-    // ATTENTIONE: reverse in-place here to avoid problems for observations datastructures (and use Modifier iterator later within writeStates)  !!!!!!!!
-    reverse(contigObservationsR);      
+    addTruncCounts(contigObservationsR, outsideR, options.maxTruncCount2);
 
     if (options.verbosity >= 2) std::cout << "... observations loaded" << std::endl;
 #ifdef HMM_PROFILE
@@ -224,6 +227,236 @@ int loadObservations(TContigObservations &contigObservationsF, TContigObservatio
 }
 
 
+// load observations of contig from BAM stream (contigs have to be loaded in the same order as in the BAM file)
+template <typename TContigObservations, typename TStore>
+int loadObservations(TContigObservations &contigObservationsF, TContigObservations &contigObservationsR, unsigned contigId, BamStream &bamStream, TStore &store, AppOptions &options)
+{
+#ifdef HMM_PROFILE
+    double timeStamp = sysTime();
+#endif
+
+    // Translate from contig name to rID.
+    int rID = 0;
+    if (!getIdByName(rID, contigNamesCache(context(bamStream.inFile)), store.contigNameStore[contigId]))
+    {
+        if (options.verbosity >= 2) std::cout << "NOTE: Contig " << store.contigNameStore[contigId] << " not existing in BAM file.\n";
+        return 2; 
+    }
+
+    unsigned contigLen = contigLength(store, contigId);
+    init(contigObservationsF, contigLen);
+    init(contigObservationsR, contigLen);
+
+    String<unsigned> outsideR;
+    if (!parse_bamContig(contigObservationsF, contigObservationsR, outsideR, bamStream, rID, options))
+    {
+        clear(contigObservationsF);
+        clear(contigObservationsR);
+        return (bamStream.unsorted) ? 1 : 2;
+    }
+    addTruncCounts(contigObservationsR, outsideR, options.maxTruncCount2);
+
+#ifdef HMM_PROFILE
+    Times::instance().time_loadObservations += (sysTime() - timeStamp);
+#endif
+    return 0;
+}
+
+
+// load observations of contig from read start count index (.pctc) instead of BAM file
+template <typename TContigObservations, typename TStore>
+int loadObservations(TContigObservations &contigObservationsF, TContigObservations &contigObservationsR, unsigned contigId, TruncCountIndex const &truncCountIndex, TStore &store, AppOptions &options)
+{
+#ifdef HMM_PROFILE
+    double timeStamp = sysTime();
+#endif
+
+    unsigned contigLen = contigLength(store, contigId);
+    int result = readTruncCounts(contigObservationsF, contigObservationsR, truncCountIndex, store.contigNameStore[contigId], contigLen, options);
+    if (result == 2 && options.verbosity >= 2) 
+        std::cout << "NOTE: Contig " << store.contigNameStore[contigId] << " not existing in read start count index.\n";
+    if (result != 0)
+    {
+        clear(contigObservationsF);
+        clear(contigObservationsR);
+        return result;
+    }
+    // no alignments
+    if (empty(contigObservationsF) && empty(contigObservationsR))
+        return 2;
+
+#ifdef HMM_PROFILE
+    Times::instance().time_loadObservations += (sysTime() - timeStamp);
+#endif
+    return 0;
+}
+
+
+// check if contigs are given in the same order as in BAM file (required to stream BAM file)
+template <typename TStore>
+bool checkContigOrder(String<unsigned> const &contigIds, CharString const &bamFileName, TStore &store)
+{
+    BamFileIn inFile;
+    if (!open(inFile, toCString(bamFileName)))
+    {
+        std::cerr << "ERROR: Could not open " << bamFileName << " for reading.\n";
+        return false;
+    }
+    BamHeader header;
+    readHeader(header, inFile);
+
+    int prev_rID = -1;
+    for (unsigned i = 0; i < length(contigIds); ++i)
+    {
+        int rID = 0;
+        if (!getIdByName(rID, contigNamesCache(context(inFile)), store.contigNameStore[contigIds[i]]))
+            continue;
+        if (rID <= prev_rID)
+            return false;
+        prev_rID = rID;
+    }
+    return true;
+}
+
+
+// load observations for multiple contigs (e.g. for learning): 
+// contigs are split into regions of options.parseRegionSize, which are decoded in parallel, each with its own BamFileIn
+// results[i]: 0 if loaded, 1 if error, 2 if no alignments or contig not existing in BAM file
+template <typename TContigObservations, typename TBai, typename TStore>
+void loadObservations(String<TContigObservations> &contigObservationsF, String<TContigObservations> &contigObservationsR, String<int> &results, 
+                      String<unsigned> const &contigIds, CharString bamFileName, TBai &baiIndex, TStore &store, AppOptions &options)
+{
+#ifdef HMM_PROFILE
+    double timeStamp = sysTime();
+#endif
+    resize(contigObservationsF, length(contigIds), Exact());
+    resize(contigObservationsR, length(contigIds), Exact());
+    resize(results, length(contigIds), 2, Exact());
+
+    if (options.verbosity >= 2) std::cout << "Parse alignments ... " << std::endl;
+    BamFileIn inFile;
+    if (!open(inFile, toCString(bamFileName)))
+    {
+        std::cerr << "ERROR: Could not open " << bamFileName << " for reading.\n";
+        for (unsigned i = 0; i < length(contigIds); ++i)
+            results[i] = 1;
+        return;
+    }
+    BamHeader header;
+    readHeader(header, inFile);
+
+    // split contigs into regions
+    String<int> rIDs;
+    resize(rIDs, length(contigIds), -1, Exact());
+    String<unsigned> regionContigs;
+    String<unsigned> regionBegins;
+    String<unsigned> regionEnds;
+    for (unsigned i = 0; i < length(contigIds); ++i)
+    {
+        // Translate from contig name to rID.
+        if (!getIdByName(rIDs[i], contigNamesCache(context(inFile)), store.contigNameStore[contigIds[i]]))
+        {
+            if (options.verbosity >= 2) std::cout << "NOTE: Contig " << store.contigNameStore[contigIds[i]] << " not existing in BAM file.\n";
+            continue;
+        }
+        unsigned contigLen = contigLength(store, contigIds[i]);
+        init(contigObservationsF[i], contigLen);
+        init(contigObservationsR[i], contigLen);
+
+        for (unsigned beginPos = 0; beginPos < contigLen; beginPos += options.parseRegionSize)
+        {
+            appendValue(regionContigs, i);
+            appendValue(regionBegins, beginPos);
+            appendValue(regionEnds, std::min(beginPos + options.parseRegionSize, contigLen));
+        }
+    }
+
+    // read start counts of each region, appended to contig afterwards
+    String<ContigObservations> regionObservationsF;
+    String<ContigObservations> regionObservationsR;
+    resize(regionObservationsF, length(regionContigs), Exact());
+    resize(regionObservationsR, length(regionContigs), Exact());
+    String<String<unsigned> > outsideR;
+    resize(outsideR, length(regionContigs), Exact());
+    String<int> regionResults;      // 0: alignments parsed, 1: error, 2: jump failed, 3: no alignments
+    resize(regionResults, length(regionContigs), 0, Exact());
+#if HMM_PARALLEL
+    SEQAN_OMP_PRAGMA(parallel for schedule(dynamic, 1) num_threads(options.numThreads)) 
+#endif  
+    for (unsigned r = 0; r < length(regionContigs); ++r)
+    {
+        unsigned i = regionContigs[r];
+        BamFileIn regionInFile;
+        if (!open(regionInFile, toCString(bamFileName)))
+        {
+            SEQAN_OMP_PRAGMA(critical)
+            std::cerr << "ERROR: Could not open " << bamFileName << " for reading.\n";
+            regionResults[r] = 1;
+            continue;
+        }
+        BamHeader regionHeader;
+        readHeader(regionHeader, regionInFile);
+
+        init(regionObservationsF[r], contigObservationsF[i].contigLength);
+        init(regionObservationsR[r], contigObservationsR[i].contigLength);
+        bool hasAlignments = false;
+        if (!parse_bamRegion(regionObservationsF[r], regionObservationsR[r], outsideR[r], hasAlignments, regionInFile, baiIndex, rIDs[i], regionBegins[r], regionEnds[r], options))
+            regionResults[r] = 2;
+        else if (!hasAlignments)
+            regionResults[r] = 3;
+    }
+
+    // combine results of regions
+    String<bool> hasAlignments;
+    resize(hasAlignments, length(contigIds), false, Exact());
+    for (unsigned r = 0; r < length(regionContigs); ++r)
+    {
+        unsigned i = regionContigs[r];
+        if (regionResults[r] == 0)
+            hasAlignments[i] = true;
+        else if (regionResults[r] == 1)
+            results[i] = 1;
+        else if (regionResults[r] == 2 && results[i] != 1)
+            results[i] = 3;     // mark as failed
+    }
+    for (unsigned i = 0; i < length(contigIds); ++i)
+    {
+        if (results[i] == 3)
+            results[i] = 2;
+        else if (results[i] != 1 && hasAlignments[i])
+            results[i] = 0;
+    }
+    // regions of a contig are in ascending order
+    for (unsigned r = 0; r < length(regionContigs); ++r)
+    {
+        if (results[regionContigs[r]] != 0) continue;
+        append(contigObservationsF[regionContigs[r]], regionObservationsF[r], options.maxTruncCount2);
+        append(contigObservationsR[regionContigs[r]], regionObservationsR[r], options.maxTruncCount2);
+        clear(regionObservationsF[r]);
+        clear(regionObservationsR[r]);
+    }
+    for (unsigned r = 0; r < length(regionContigs); ++r)
+    {
+        if (results[regionContigs[r]] == 0)
+            addTruncCounts(contigObservationsR[regionContigs[r]], outsideR[r], options.maxTruncCount2);
+    }
+
+    for (unsigned i = 0; i < length(contigIds); ++i)
+    {
+        if (results[i] != 0)
+        {
+            clear(contigObservationsF[i]);
+            clear(contigObservationsR[i]);
+        }
+    }
+
+    if (options.verbosity >= 2) std::cout << "... observations loaded" << std::endl;
+#ifdef HMM_PROFILE
+    Times::instance().time_loadObservations += (sysTime() - timeStamp);
+#endif
+}
+
+
 template <typename TBai, typename TStore, typename TOptions>
 bool loadBAMCovariates(Data &data, TBai &inputBaiIndex, TStore &store, bool parallelize, TOptions &options)
 {
@@ -271,7 +504,7 @@ bool loadBAMCovariates(Data &data, TBai &inputBaiIndex, TStore &store, bool para
             }
             else
             {
-                unsigned beginPos = length(store.contigStore[data.setObs[s][i].contigId].seq) - (data.setObs[s][i].length() + data.setPos[s][i]);
+                unsigned beginPos = contigLength(store, data.setObs[s][i].contigId) - (data.setObs[s][i].length() + data.setPos[s][i]);
                 unsigned endPos = beginPos + data.setObs[s][i].length();
 
                 parse_bamRegion(truncCounts, inFile, inputBaiIndex, rID, beginPos, endPos, false, options);
@@ -289,161 +522,140 @@ bool loadBAMCovariates(Data &data, TBai &inputBaiIndex, TStore &store, bool para
 }
 
 
-// precomputed 
+// precomputed background signal covariates: BED file is parsed once for all contigs
 template <typename TStore>
-bool loadCovariates(String<double> &contigCovsF, String<double> &contigCovsR, unsigned contigId, TStore &store, AppOptions &options)
+bool loadCovariates(Covariates &covariates, TStore &store, AppOptions &options)
 {   
-    if (!empty(options.rpkmFileName)) 
-    {
-        double minRPKM = 0.0;
-        if (options.useLogRPKM) 
-            minRPKM = options.minRPKMtoFit - 1.0; 
-        
-        resize(contigCovsF, length(store.contigStore[contigId].seq), minRPKM, Exact());
-        resize(contigCovsR, length(store.contigStore[contigId].seq), minRPKM, Exact());
+    typedef StringSet<CharString>   TNameStore;
 
-        if (options.verbosity >= 1) std::cout << "Parse covariates ... input signal" << std::endl;
-        BedFileIn bedIn(toCString(options.rpkmFileName));
-        BedRecord<Bed6> bedRecord;      
-        while (!atEnd(bedIn))
-        {
-            try
-            {
-                readRecord(bedRecord, bedIn);
-            }
-            catch (ParseError const & e)
-            {
-                std::cerr << "ERROR: input BED record is badly formatted. " << e.what() << "\n";
-            }
-            catch (IOError const & e)
-            {
-                std::cerr << "ERROR: could not copy input BED record. " << e.what() << "\n";
-            } 
+    resize(covariates.rpkmIntervals, length(store.contigNameStore), Exact());
+    for (unsigned contigId = 0; contigId < length(store.contigNameStore); ++contigId)
+        resize(covariates.rpkmIntervals[contigId], 2, Exact());
+    if (empty(options.rpkmFileName)) 
+        return true;
 
-            if (bedRecord.ref == store.contigNameStore[contigId])   
-            {
-               if (bedRecord.strand == '+')
-               {
-                    std::stringstream ss(toCString(bedRecord.score)); 
-                    double score;
-                    ss >> score;
-                    if (options.useLogRPKM  && score > 0.0)
-                        score = log(score);
-                    else if (options.useLogRPKM)
-                        score = minRPKM;
-
-                    for (int i = bedRecord.beginPos; i < bedRecord.endPos; ++i)
-                    {
-                        if (contigCovsF[i] == minRPKM)
-                            contigCovsF[i] = score;
-                        else
-                            contigCovsF[i] = std::max(score, contigCovsF[i]);
-                    }
-               }
-               else
-               {
-                    std::stringstream ss(toCString(bedRecord.score)); 
-                    double score;
-                    ss >> score;
-                    if (options.useLogRPKM && score > 0.0)
-                        score = log(score);
-                    else if (options.useLogRPKM)
-                        score = minRPKM;
-
-                    for (int i = bedRecord.beginPos; i < bedRecord.endPos; ++i)
-                    {
-                         if (contigCovsR[i] == minRPKM)
-                            contigCovsR[i] = score;
-                        else
-                            contigCovsR[i] = std::max(score, contigCovsR[i]);
-                   }
-               }
-            }
+    if (options.verbosity >= 1) std::cout << "Parse covariates ... input signal" << std::endl;
+    BedFileIn bedIn;
+    if (!open(bedIn, toCString(options.rpkmFileName)))
+    {
+        std::cerr << "ERROR: Could not open " << options.rpkmFileName << " for reading.\n";
+        return false;
+    }
+    NameStoreCache<TNameStore>  nameStoreCache(store.contigNameStore);
+    BedRecord<Bed6> bedRecord;      
+    unsigned recordNo = 0;
+    while (!atEnd(bedIn))
+    {
+        try
+        {
+            readRecord(bedRecord, bedIn);
+        }
+        catch (ParseError const & e)
+        {
+            std::cerr << "ERROR: input BED record is badly formatted. " << e.what() << "\n";
+        }
+        catch (IOError const & e)
+        {
+            std::cerr << "ERROR: could not copy input BED record. " << e.what() << "\n";
         } 
 
-        // ATTENTIONE: reverse in-place here to avoid problems for observations datastructures (and use Modifier iterator later within writeStates)  !!!!!!!!
-        reverse(contigCovsR);      
+        unsigned contigId;
+        if (!getIdByName(contigId, nameStoreCache, bedRecord.ref))
+            continue;
+        unsigned contigLen = contigLength(store, contigId);
+
+        CovariateRecord record;
+        record.beginPos = std::max(bedRecord.beginPos, 0);
+        record.endPos = std::min(std::max(bedRecord.endPos, 0), (int)contigLen);
+        record.recordNo = recordNo++;
+        std::stringstream ss(toCString(bedRecord.score)); 
+        ss >> record.score;
+        if (record.beginPos >= record.endPos)
+            continue;
 
-        if (options.verbosity >= 2) std::cout << "... covariates loaded" << std::endl;
-    }
-    return 0;
+        unsigned s = (bedRecord.strand == '+') ? 0 : 1;
+        appendValue(covariates.rpkmIntervals[contigId][s].records, record, Generous());
+    } 
+
+    for (unsigned contigId = 0; contigId < length(covariates.rpkmIntervals); ++contigId)
+        for (unsigned s = 0; s < 2; ++s)
+            sortRecords(covariates.rpkmIntervals[contigId][s]);
+
+    if (options.verbosity >= 2) std::cout << "... covariates loaded" << std::endl;
+    return true;
 }
 
 
+// motif score covariates: FIMO BED file is parsed once for all contigs
 template <typename TStore>
-bool loadMotifCovariates(String<String<float> > &contigCovs, String<String<char> > &motifIds, unsigned contigId, TStore &store, AppOptions &options)
+bool loadMotifCovariates(Covariates &covariates, TStore &store, AppOptions &options)
 {   
-    
-    resize(contigCovs, 2, Exact());
-    resize(motifIds, 2, Exact());
-    for (unsigned s = 0; s < 2; ++s)
+    typedef StringSet<CharString>   TNameStore;
+
+    resize(covariates.motifHits, length(store.contigNameStore), Exact());
+    for (unsigned contigId = 0; contigId < length(store.contigNameStore); ++contigId)
+        resize(covariates.motifHits[contigId], 2, Exact());
+    if (empty(options.fimoFileName)) 
+        return true;
+
+    if (options.verbosity >= 2) std::cout << "Parse covariates ... fimo scores for input motifs" << std::endl;
+    BedFileIn bedIn;
+    if (!open(bedIn, toCString(options.fimoFileName)))
     {
-        resize(contigCovs[s], length(store.contigStore[contigId].seq), 0.0, Exact());
-        resize(motifIds[s], length(store.contigStore[contigId].seq), 0, Exact());
+        std::cerr << "ERROR: Could not open " << options.fimoFileName << " for reading.\n";
+        return false;
     }
-
-    if (!empty(options.fimoFileName)) 
+    NameStoreCache<TNameStore>  nameStoreCache(store.contigNameStore);
+    BedRecord<Bed6> bedRecord;      
+    while (!atEnd(bedIn))
     {
-        if (options.verbosity >= 2) std::cout << "Parse covariates ... fimo scores for input motifs" << std::endl;
-        BedFileIn bedIn(toCString(options.fimoFileName));
-        BedRecord<Bed6> bedRecord;      
-        while (!atEnd(bedIn))
+        try
         {
-            try
-            {
-                readRecord(bedRecord, bedIn);
-            }
-            catch (ParseError const & e)
-            {
-                std::cerr << "ERROR: input BED record is badly formatted. " << e.what() << "\n";
-            }
-            catch (IOError const & e)
-            {
-                std::cerr << "ERROR: could not copy input BED record. " << e.what() << "\n";
-            } 
+            readRecord(bedRecord, bedIn);
+        }
+        catch (ParseError const & e)
+        {
+            std::cerr << "ERROR: input BED record is badly formatted. " << e.what() << "\n";
+        }
+        catch (IOError const & e)
+        {
+            std::cerr << "ERROR: could not copy input BED record. " << e.what() << "\n";
+        } 
 
-            if (bedRecord.ref == store.contigNameStore[contigId])   
+        unsigned contigId;
+        if (!getIdByName(contigId, nameStoreCache, bedRecord.ref))
+            continue;
+
+        std::stringstream ss(toCString(bedRecord.score)); 
+        double score;
+        ss >> score;
+
+        // assume only one motif with one score for each position!
+        // assume id 1-based
+        unsigned id = atoi(toCString(bedRecord.name)) - 1;     
+        if (id < options.nInputMotifs)
+        {
+            if (bedRecord.beginPos >= 0 && bedRecord.beginPos < (int)contigLength(store, contigId))
             {
-                std::stringstream ss(toCString(bedRecord.score)); 
-                double score;
-                ss >> score;
-
-                // assume only one motif with one score for each position!
-                // assume id 1-based
-                unsigned id = atoi(toCString(bedRecord.name)) - 1;     
-                if (id < options.nInputMotifs)
-                {
-                    if (bedRecord.strand == '+')
-                    {
-                        if (bedRecord.beginPos < (int)length(contigCovs[0]))
-                        {
-                            contigCovs[0][bedRecord.beginPos] = std::max(score, 0.0);         // ignore negative scores for the moment
-                            motifIds[0][bedRecord.beginPos] = id;
-                        }
-                        else
-                            std::cout << "Warning: beginPos of fimo score is not within contig! Ignored. (contigName: " << bedRecord.ref << ", beginPos: " << bedRecord.beginPos << ")" << std::endl;
-                    }
-                    else
-                    {
-                        if (bedRecord.beginPos < (int)length(contigCovs[1]))
-                        {
-                            contigCovs[1][bedRecord.beginPos] = std::max(score, 0.0);
-                            motifIds[1][bedRecord.beginPos] = id;
-                        }
-                        else
-                            std::cout << "Warning: beginPos of fimo score is not within contig! Ignored. (contigName: " << bedRecord.ref << ", beginPos: " << bedRecord.beginPos << ")" << std::endl;
-                    }
-                }
+                MotifHit hit;
+                hit.pos = bedRecord.beginPos;
+                hit.score = std::max(score, 0.0);         // ignore negative scores for the moment
+                hit.motifId = id;
+                unsigned s = (bedRecord.strand == '+') ? 0 : 1;
+                appendValue(covariates.motifHits[contigId][s], hit, Generous());
             }
-        } 
+            else
+                std::cout << "Warning: beginPos of fimo score is not within contig! Ignored. (contigName: " << bedRecord.ref << ", beginPos: " << bedRecord.beginPos << ")" << std::endl;
+        }
+    } 
 
-        // ATTENTIONE: reverse in-place here to avoid problems for observations datastructures (and use Modifier iterator later within writeStates)  !!!!!!!!
-        reverse(contigCovs[1]);    
-        reverse(motifIds[1]);  
+    // stable: last hit given for a position is used
+    for (unsigned contigId = 0; contigId < length(covariates.motifHits); ++contigId)
+        for (unsigned s = 0; s < 2; ++s)
+            std::stable_sort(begin(covariates.motifHits[contigId][s], Standard()), end(covariates.motifHits[contigId][s], Standard()));
 
-        if (options.verbosity >= 2) std::cout << "... fimo input motif score covriates loaded" << std::endl;
-    }
-    return 0;
+    if (options.verbosity >= 2) std::cout << "... fimo input motif score covriates loaded" << std::endl;
+    return true;
 }
 
 
@@ -548,9 +760,7 @@ void cleanCoveredIntervals(Data &data, unsigned contigLength, bool learning, TOp
 template <typename TContigObservations, typename TStore, typename TOptions>
 void extractCoveredIntervals(Data &data, 
                              TContigObservations &contigObservationsF, TContigObservations &contigObservationsR,
-                             String<double> &contigCovsF, String<double> &contigCovsR,
-                             String<String<float> > &contigCovsFimo, 
-                             String<String<char> > &motifIds, 
+                             Covariates const &covariates,
                              unsigned contigId, 
                              unsigned i1, unsigned i2,
                              bool excludePolyA,
@@ -563,6 +773,14 @@ void extractCoveredIntervals(Data &data,
 
     unsigned countPolyAs = 0;
     unsigned countPolyTs = 0;
+    Dna5String intervalSeq;                        // reference sequence of covered interval, only loaded for polyA/polyT checks
+    ReferenceReader referenceReader;               // own file access, contigs are processed in parallel
+    if ((excludePolyA || excludePolyT) && !open(referenceReader, store))
+    {
+        std::cerr << "WARNING: Could not access reference sequence, polyA/polyU regions are not excluded for contig " << store.contigNameStore[contigId] << ".\n";
+        excludePolyA = false;
+        excludePolyT = false;
+    }
     // FORWARD                                      // TODO merge code F and R!
     unsigned c1;                                   // covered interval begin
     unsigned c2;                                   // covered interval end
@@ -574,7 +792,7 @@ void extractCoveredIntervals(Data &data,
     while (i < i2 && (prev_c2 < i2 && !prev_dis))
     {
 
-        while (i < i2 && contigObservationsF.truncCounts[i] == 0) ++i;    // find begin of covered interval     
+        i = nextCoveredPos(contigObservationsF, i, i2);    // find begin of covered interval     
         c1 = i;
         //std::cout << "TEST: i " << i << std::endl;
         if (((int)c1 - (int)options.intervalOffset) > (int)prev_c2)    // if gap bigger than intervalOffset, shift c1 to left
@@ -591,7 +809,7 @@ void extractCoveredIntervals(Data &data,
             ++i;
             if (i >= i2) break;
                 
-            while (i < i2 && contigObservationsF.truncCounts[i] > 0) ++i;      // find end of covered interval
+            i = coveredRunEnd(contigObservationsF, i, i2);      // find end of covered interval
             c2 = std::min(i + options.intervalOffset, i2);
             prev_c2 = c2;
             continue;
@@ -608,12 +826,14 @@ void extractCoveredIntervals(Data &data,
 
         if (i >= i2) break;
             
-        while (i < i2 && contigObservationsF.truncCounts[i] > 0) ++i;      // find end of covered interval
+        i = coveredRunEnd(contigObservationsF, i, i2);      // find end of covered interval
         c2 = std::min(i + options.intervalOffset, i2);
 
+        if (excludePolyA || excludePolyT)
+            getSequence(intervalSeq, referenceReader, contigId, c1, c2);
         if (excludePolyA) // check if covered interval contains internal polyA  
         {
-            if (checkForPolyA(infix(store.contigStore[contigId].seq, c1, c2), options)) 
+            if (checkForPolyA(intervalSeq, options)) 
             {
                 ++countPolyAs;
                 prev_dis = true;
@@ -623,7 +843,7 @@ void extractCoveredIntervals(Data &data,
         }
         if (excludePolyT) // check for polyT (polyU) 
         {
-            if (checkForPolyT(infix(store.contigStore[contigId].seq, c1, c2), options)) 
+            if (checkForPolyT(intervalSeq, options)) 
             {
                 ++countPolyTs;
                 prev_dis = true;
@@ -637,24 +857,24 @@ void extractCoveredIntervals(Data &data,
         // create observations for current covered interval
         //std::cout << "   parsed interval: " << c1 << " - " << c2 << " ..."  << std::endl;
         Observations observations;
-        observations.truncCounts = infix(contigObservationsF.truncCounts, c1, c2);
+        getTruncCounts(observations.truncCounts, contigObservationsF, c1, c2);
         observations.contigId = contigId;
         if (!empty(options.rpkmFileName))
         {
-            observations.rpkms = infix(contigCovsF, c1, c2); 
+            getRpkms(observations.rpkms, covariates.rpkmIntervals[contigId][0], contigLength(store, contigId), c1, c2, false, options); 
         }
         if (options.useFimoScore)
         {
-            observations.fimoScores = infix(contigCovsFimo[0], c1, c2); 
-            observations.motifIds = infix(motifIds[0], c1, c2); 
+            getMotifScores(observations.fimoScores, observations.motifIds, covariates.motifHits[contigId][0], contigLength(store, contigId), c1, c2, false); 
         }
         //std::cout << "TEST: append c1 " << c1 << " c2: " << c2 << std::endl;
         appendValue(data.setObs[0], observations, Generous());
         appendValue(data.setPos[0], c1, Generous());
     }
-    // REVERSE 
-    unsigned i1_R = length(contigObservationsR.truncCounts) - i2;
-    unsigned i2_R = length(contigObservationsR.truncCounts) - i1;
+    // REVERSE: reverse strand coordinates t_R = len - t - 1, observations and covariates are stored in forward coordinates
+    ReverseContigObservations reverseObservationsR(contigObservationsR);
+    unsigned i1_R = contigObservationsR.contigLength - i2;
+    unsigned i2_R = contigObservationsR.contigLength - i1;
     i = i1_R;
     prev_c1 = i1_R;
     prev_c2 = i1_R;
@@ -662,7 +882,7 @@ void extractCoveredIntervals(Data &data,
     if (options.verbosity >= 2) std::cout << "R: Parse covered intervals and get observations  ..." << "i1_R: " << i1_R << " i2_R: " << i2_R << std::endl;
     while (i < i2_R && (prev_c2 < i2_R && !prev_dis))
     {
-        while (i < i2_R && contigObservationsR.truncCounts[i] == 0) ++i;    // find begin of covered interval
+        i = nextCoveredPos(reverseObservationsR, i, i2_R);    // find begin of covered interval
         c1 = i;
         if (((int)c1 - (int)options.intervalOffset) > (int)prev_c2)    // if gap bigger than intervalOffset, shift c1 to left
         {
@@ -678,7 +898,7 @@ void extractCoveredIntervals(Data &data,
             ++i;
             if (i >= i2_R) break;
                 
-            while (i < i2_R && contigObservationsR.truncCounts[i] > 0) ++i;      // find end of covered interval
+            i = coveredRunEnd(reverseObservationsR, i, i2_R);      // find end of covered interval
             c2 = std::min(i + options.intervalOffset, i2_R);
             prev_c2 = c2;
             continue;
@@ -694,12 +914,14 @@ void extractCoveredIntervals(Data &data,
 
         if (i >= i2_R) break;
 
-        while (i < i2_R && contigObservationsR.truncCounts[i] > 0) ++i;      // find end of covered interval
+        i = coveredRunEnd(reverseObservationsR, i, i2_R);      // find end of covered interval
         c2 = std::min(i + options.intervalOffset, i2_R);
 
+        if (excludePolyA || excludePolyT)       // forward strand sequence, checked for complementary bases
+            getSequence(intervalSeq, referenceReader, contigId, (int)contigLength(store, contigId) - (int)c2 - 1, (int)contigLength(store, contigId) - (int)c1 - 1);
         if (excludePolyA) // check if covered interval contains internal polyA  
         {
-            if (checkForPolyT(infix(store.contigStore[contigId].seq, length(store.contigStore[contigId].seq)-c2-1, length(store.contigStore[contigId].seq)-c1-1), options)) 
+            if (checkForPolyT(intervalSeq, options)) 
             {
                 ++countPolyAs;
                 prev_dis = true;
@@ -709,7 +931,7 @@ void extractCoveredIntervals(Data &data,
         }
         if (excludePolyT) // check for polyT (polyU)  
         {
-            if (checkForPolyA(infix(store.contigStore[contigId].seq, length(store.contigStore[contigId].seq)-c2-1, length(store.contigStore[contigId].seq)-c1-1), options)) 
+            if (checkForPolyA(intervalSeq, options)) 
             {
                 ++countPolyTs;
                 prev_dis = true;
@@ -722,16 +944,15 @@ void extractCoveredIntervals(Data &data,
 
         // create observations for current covered interval
         Observations observations; 
-        observations.truncCounts = infix(contigObservationsR.truncCounts, c1, c2);
+        getTruncCounts(observations.truncCounts, reverseObservationsR, c1, c2);
         observations.contigId = contigId;
         if (options.useFimoScore)
         {
-            observations.fimoScores = infix(contigCovsFimo[1], c1, c2);
-            observations.motifIds = infix(motifIds[1], c1, c2); 
+            getMotifScores(observations.fimoScores, observations.motifIds, covariates.motifHits[contigId][1], contigLength(store, contigId), c1, c2, true); 
         }
         if (!empty(options.rpkmFileName))
         {
-            observations.rpkms = infix(contigCovsR, c1, c2);
+            getRpkms(observations.rpkms, covariates.rpkmIntervals[contigId][1], contigLength(store, contigId), c1, c2, true, options);
         }
         appendValue(data.setObs[1], observations, Generous());
         appendValue(data.setPos[1], c1, Generous());
@@ -744,59 +965,88 @@ void extractCoveredIntervals(Data &data,
         if (excludePolyT) std::cout << " Excluded " << countPolyTs << " covered intervals from analysis because of internal polyU sites! " << std::endl;
         std::cout << " No. of remaining intervals: " << (length(data.setObs[0]) + length(data.setObs[1])) << "   F: " << length(data.setObs[0]) << "   R: " << length(data.setObs[1]) << std::endl;
     }
-    cleanCoveredIntervals(data, length(store.contigStore[contigId].seq), learning, options);
+    cleanCoveredIntervals(data, contigLength(store, contigId), learning, options);
     if (options.verbosity >= 2) 
         std::cout << " No. of remaining intervals after cleaning up: " << (length(data.setObs[0]) + length(data.setObs[1])) << "   F: " << length(data.setObs[0]) << "   R: " << length(data.setObs[1]) << std::endl;
 }
 
 
+// running means and co-moments for simple linear regression (Welford), can be merged (Chan et al.)
+struct SLRStats
+{
+    double n;
+    double meanX;
+    double meanY;
+    double m2X;         // sum of squared deviations of x
+    double cXY;         // sum of products of deviations of x and y
+
+    SLRStats() : n(0.0), meanX(0.0), meanY(0.0), m2X(0.0), cXY(0.0) {}
+};
+
+inline void add(SLRStats &stats, double x, double y)
+{
+    stats.n += 1.0;
+    double dx = x - stats.meanX;
+    stats.meanX += dx / stats.n;
+    stats.meanY += (y - stats.meanY) / stats.n;
+    stats.m2X += dx * (x - stats.meanX);
+    stats.cXY += dx * (y - stats.meanY);
+}
+
+inline void merge(SLRStats &stats, SLRStats const &other)
+{
+    if (other.n == 0.0) return;
+    if (stats.n == 0.0)
+    {
+        stats = other;
+        return;
+    }
+    double n = stats.n + other.n;
+    double dx = other.meanX - stats.meanX;
+    double dy = other.meanY - stats.meanY;
+    stats.m2X += other.m2X + dx * dx * stats.n * other.n / n;
+    stats.cXY += other.cXY + dx * dy * stats.n * other.n / n;
+    stats.meanX += dx * other.n / n;
+    stats.meanY += dy * other.n / n;
+    stats.n = n;
+}
+
+
 // simple linear regression: kde -> N (window count)
+// NOTE: KDEs and window counts have to be computed before
 template <typename TOptions>
 void computeSLR(double &b0, double &b1, Data &data, TOptions &options) // TODO check result
 {
-    unsigned w_50 = floor((double)options.bandwidthN - 0.1);    // binSize should be odd
+    std::cout << "  Compute SLR ... " << std::endl;
 
-    String<double> kdes;
-    String<unsigned> counts;
+    // intervals are split into one block per thread, block results are merged in fixed order (independent of thread scheduling)
+    unsigned noBlocks = std::max(options.numThreads, (unsigned)1);
+    String<SLRStats> blockStats;
+    resize(blockStats, 2 * noBlocks, Exact());
     for (unsigned s = 0; s < 2; ++s)
     {
-        for (unsigned i = 0; i < length(data.setObs[s]); ++i)
+        unsigned noIntervals = length(data.setObs[s]);
+#if HMM_PARALLEL
+        SEQAN_OMP_PRAGMA(parallel for schedule(static, 1) num_threads(options.numThreads)) 
+#endif
+        for (unsigned b = 0; b < noBlocks; ++b)
         {
-            // KDE - window truncCount relationship 
-            for (unsigned t = 0; t < data.setObs[s][i].length(); ++t)
+            unsigned i1 = (unsigned)(((unsigned long)b * noIntervals) / noBlocks);
+            unsigned i2 = (unsigned)(((unsigned long)(b + 1) * noIntervals) / noBlocks);
+            for (unsigned i = i1; i < i2; ++i)
             {
-                unsigned sum = 0;
-                for (unsigned j = std::max((int)t - (int)w_50, (int)0); (j < data.setObs[s][i].length()) && (j <= t + w_50); ++j)  // inefficient... update on the fly
-                    sum += data.setObs[s][i].truncCounts[j];
-                
-                appendValue(kdes, data.setObs[s][i].kdesN[t], Generous());
-                appendValue(counts, sum, Generous());
-                // = std::max(sum, (unsigned)1);  // TODO avoid becoming 0 !
-                //out << setObsF[i].kdes[t] << '\t' << sum << '\n';
+                // KDE - window truncCount relationship 
+                for (unsigned t = 0; t < data.setObs[s][i].length(); ++t)
+                    add(blockStats[s * noBlocks + b], data.setObs[s][i].kdesN[t], (double)data.setObs[s][i].windowCounts[t]);
             }
         }
     }
-    std::cout << "  Compute SLR ... " << std::endl;
-    double mean_kde = 0.0;
-    double mean_count = 0.0;
-    for (unsigned i = 0; i < length(kdes); ++i)
-    {
-        mean_kde += kdes[i];
-        mean_count += counts[i];
-    }
-    mean_kde = mean_kde/(double)length(kdes);
-    mean_count = (double)mean_count/(double)length(counts);
-
-    double sum1 = 0;
-    double sum2 = 0;
-    for (unsigned i = 0; i < length(kdes); ++i)
-    {
-       sum1 += (kdes[i] - mean_kde) * ((double)counts[i] - mean_count);
-       sum2 += pow((kdes[i] - mean_kde), 2);
-    }
+    SLRStats stats;
+    for (unsigned b = 0; b < length(blockStats); ++b)
+        merge(stats, blockStats[b]);
 
-    b1 = sum1 / sum2;
-    b0 = mean_count - b1*mean_kde;
+    b1 = stats.cXY / stats.m2X;
+    b0 = stats.meanY - b1*stats.meanX;
 
     if (options.verbosity >= 2) std::cout << "Simple linear regression (count <- kde): b0 = " << b0 << " and b1 = " << b1 << " ." << std::endl;
 }
@@ -835,6 +1085,7 @@ void preproCoveredIntervals(Data &data, double &b0, double &b1, TBai &inputBaiIn
                 data.setObs[s][i].estimateNs(options);
 
             clear(data.setObs[s][i].kdesN); // only used to estimate Ns
+            clear(data.setObs[s][i].windowCounts);
         }
     }
 
@@ -888,7 +1139,7 @@ bool learnHMM(Data &data,
     // TODO optimize!
 
     modelParams.transMatrix = hmm.transMatrix;
-    data.statePosteriors = hmm.statePosteriors;
+    move(data.statePosteriors, hmm.statePosteriors);
 
     if (options.verbosity >= 2) myPrint(modelParams.gamma1);
     if (options.verbosity >= 2) myPrint(modelParams.gamma2);    
@@ -904,7 +1155,10 @@ bool learnHMM(Data &data,
 template <typename TGamma, typename TBIN, typename TStore, typename TOptions>
 bool learnModel(String<ModelParams<TGamma, TBIN> > &modelParams, 
                 String<BamIndex<Bai> > &baiIndices, 
+                String<TruncCountIndex> const &truncCountIndices, 
                 BamIndex<Bai> &inputBaiIndex, 
+                Covariates const &covariates, 
+                TruncCountCache &truncCountCache, 
                 TStore &store, 
                 TOptions &options)
 {
@@ -918,19 +1172,33 @@ bool learnModel(String<ModelParams<TGamma, TBIN> > &modelParams,
         else if (options.verbosity >= 1 && length(options.baiFileNames) > 1) std::cout << "Learn HMM parameters for replicate: " << rep << std::endl;
         
         // Read BAI index.
-        BamIndex<Bai> baiIndex;
-        if (!open(baiIndex, toCString(options.baiFileNames[rep])))
+        if (!options.useTruncCountIndex)
         {
-            std::cerr << "ERROR: Could not read BAI index file " << options.baiFileNames[rep] << "\n";
-            return false;
+            BamIndex<Bai> baiIndex;
+            if (!open(baiIndex, toCString(options.baiFileNames[rep])))
+            {
+                std::cerr << "ERROR: Could not read BAI index file " << options.baiFileNames[rep] << "\n";
+                return false;
+            }
+            baiIndices[rep] = baiIndex;
         }
-        baiIndices[rep] = baiIndex;
 
         // *****************
         String<ContigObservations> contigObservationsF;
         String<ContigObservations> contigObservationsR;
-        resize(contigObservationsF, length(options.intervals_contigIds), Exact());
-        resize(contigObservationsR, length(options.intervals_contigIds), Exact());
+        String<int> results;
+        BamStream bamStream;
+        if (options.streamBam || options.useTruncCountIndex)
+        {
+            // observations are loaded contig by contig within loop below
+            resize(contigObservationsF, length(options.intervals_contigIds), Exact());
+            resize(contigObservationsR, length(options.intervals_contigIds), Exact());
+            resize(results, length(options.intervals_contigIds), 1, Exact());
+            if (options.streamBam && !openBamStream(bamStream, options.bamFileNames[rep]))
+                return false;
+        }
+        else    // load observations, large contigs are decoded block-wise in parallel
+            loadObservations(contigObservationsF, contigObservationsR, results, options.intervals_contigIds, options.bamFileNames[rep], baiIndices[rep], store, options);
 
         Data data;
         resize(data.setObs, 2);
@@ -939,26 +1207,27 @@ bool learnModel(String<ModelParams<TGamma, TBIN> > &modelParams,
         resize(data.states, 2);
         bool stop = false;
 #if HMM_PARALLEL
-        SEQAN_OMP_PRAGMA(parallel for schedule(dynamic, 1) num_threads(options.numThreads)) 
+        SEQAN_OMP_PRAGMA(parallel for ordered schedule(dynamic, 1) num_threads(options.numThreads)) 
 #endif  
             for (unsigned i = 0; i < length(options.intervals_contigIds); ++i)
             {
                 unsigned contigId = options.intervals_contigIds[i];
 
-                int r = loadObservations(contigObservationsF[i], contigObservationsR[i], contigId, options.bamFileNames[rep], baiIndices[rep], store, options);
-                if (r == 1)
+                if (options.streamBam)
+                {
+                    // BAM stream is parsed contig by contig in given order, while previous contigs are processed by other threads
+                    SEQAN_OMP_PRAGMA(ordered)
+                    results[i] = loadObservations(contigObservationsF[i], contigObservationsR[i], contigId, bamStream, store, options);
+                }
+                else if (options.useTruncCountIndex)
+                    results[i] = loadObservations(contigObservationsF[i], contigObservationsR[i], contigId, truncCountIndices[rep], store, options);
+
+                if (results[i] == 1)
                 {
                     stop = true; 
                 }
-                else if (r == 0)
+                else if (results[i] == 0)
                 {
-                    String<double> contigCovsF;
-                    String<double> contigCovsR;
-                    loadCovariates(contigCovsF, contigCovsR, contigId, store, options); 
-                    String<String<float> > contigCovsFimo;
-                    String<String<char> > motifIds;
-                    loadMotifCovariates(contigCovsFimo, motifIds, contigId, store, options); 
-
                     // Extract covered intervals for learning
                     unsigned i1 = options.intervals_positions[i][0];    // interval begin
                     unsigned i2 = options.intervals_positions[i][1];    // interval end
@@ -968,7 +1237,7 @@ bool learnModel(String<ModelParams<TGamma, TBIN> > &modelParams,
                     resize(c_data.statePosteriors, 2);
                     resize(c_data.states, 2);
 
-                    extractCoveredIntervals(c_data, contigObservationsF[i], contigObservationsR[i], contigCovsF, contigCovsR, contigCovsFimo, motifIds, contigId, i1, i2, options.excludePolyAFromLearning, options.excludePolyTFromLearning, true, store, options); 
+                    extractCoveredIntervals(c_data, contigObservationsF[i], contigObservationsR[i], covariates, contigId, i1, i2, options.excludePolyAFromLearning, options.excludePolyTFromLearning, true, store, options); 
 
                     SEQAN_OMP_PRAGMA(critical)
                         append(data, c_data);  
@@ -976,15 +1245,8 @@ bool learnModel(String<ModelParams<TGamma, TBIN> > &modelParams,
             }
         if (stop) return false;
 
-        // learn KDE - N relationship on all contigs used for other parameter learning as well
-        for (unsigned s = 0; s < 2; ++s)
-            for (unsigned i = 0; i < length(data.setObs[s]); ++i)
-                data.setObs[s][i].computeKDEs(options);
-
-        if (options.estimateNfromKdes) 
-            computeSLR(modelParams[rep].slr_NfromKDE_b0, modelParams[rep].slr_NfromKDE_b1, data, options);
-
         // precompute KDE values, estimate Ns, etc.
+        // (KDE - N relationship is learned here on all contigs used for other parameter learning as well)
         preproCoveredIntervals(data, modelParams[rep].slr_NfromKDE_b0, modelParams[rep].slr_NfromKDE_b1, inputBaiIndex, store, true, options);   
 
         if (options.verbosity >= 1) std::cout << "Prior ML estimation of density distribution parameters using predefined cutoff ..." << std::endl;
@@ -995,9 +1257,12 @@ bool learnModel(String<ModelParams<TGamma, TBIN> > &modelParams,
         if (!learnHMM(data, modelParams[rep], contigLen, options))
             return false;
 
+        clear(data);
+        // keep read start counts to apply model later
+        for (unsigned i = 0; i < length(options.intervals_contigIds); ++i)
+            truncCountCache.put(rep, options.intervals_contigIds[i], contigObservationsF[i], contigObservationsR[i], results[i]);
         clear(contigObservationsF);
         clear(contigObservationsR);
-        clear(data);
     }
     return true;
 }
@@ -1049,7 +1314,7 @@ bool applyHMM(Data &newData,
     if (options.useCov_RPKM)    // && !options.g1_k_le_g2_k ?  NOTE: otherwise not necessary, since gamma1.k <= 1
         mergedHmm.rmBoarderArtifacts(newData.states, data_replicates, modelParams);
 
-    newData.statePosteriors = mergedHmm.statePosteriors;
+    move(newData.statePosteriors, mergedHmm.statePosteriors);
     newData.setObs = mergedHmm.setObs;
     newData.setPos = mergedHmm.setPos;
 
@@ -1066,21 +1331,45 @@ bool applyModel(String<String<BedRecord<Bed6> > > &bedRecords_sites,
                 String<String<BedRecord<Bed6> > > &bedRecords_regions, 
                 String<ModelParams<TGamma, TBIN> > &modelParams, 
                 String<BamIndex<Bai> > &baiIndices, 
+                String<TruncCountIndex> const &truncCountIndices, 
                 BamIndex<Bai> &inputBaiIndex, 
+                Covariates const &covariates, 
+                TruncCountCache &truncCountCache, 
                 TStore &store, 
                 TOptions &options)
 {
     if (options.verbosity >= 1) std::cout << "Apply learned parameters to whole dataset ..." << std::endl;
     bool stop = false;
     
+    // if streaming, BAM files are parsed contig by contig in given order, while previous contigs are processed by other threads
+    std::unique_ptr<BamStream[]> bamStreams;
+    if (options.streamBam)
+    {
+        bamStreams.reset(new BamStream[length(options.bamFileNames)]);
+        for (unsigned rep = 0; rep < length(options.bamFileNames); ++rep)
+        {
+            if (!openBamStream(bamStreams[rep], options.bamFileNames[rep]))
+                return false;
+        }
+    }
+
+    // precompute density tables and normalizers once, modelParams are shared by all threads
+    for (unsigned rep = 0; rep < length(modelParams); ++rep)
+    {
+        updateNormalizers(modelParams[rep].gamma1);
+        updateNormalizers(modelParams[rep].gamma2);
+        updateDensityTables(modelParams[rep].bin1);
+        updateDensityTables(modelParams[rep].bin2);
+    }
+
 #if HMM_PARALLEL
     omp_set_num_threads(options.numThreadsA);
-    SEQAN_OMP_PRAGMA(parallel for schedule(dynamic, 1) num_threads(options.numThreadsA/length(options.baiFileNames)))    // TODO improve general parallelization concept 
+    SEQAN_OMP_PRAGMA(parallel for ordered schedule(dynamic, 1) num_threads(options.numThreadsA/length(options.baiFileNames)))    // TODO improve general parallelization concept 
 #endif 
     for (unsigned i = 0; i < length(options.applyChr_contigIds); ++i)
     {
         unsigned contigId = options.applyChr_contigIds[i];
-        unsigned contigLen = length(store.contigStore[contigId].seq);
+        unsigned contigLen = contigLength(store, contigId);
         bool skipContig = false;
 
         if (options.verbosity >= 1) std::cout << "  " << store.contigNameStore[contigId] << std::endl;
@@ -1092,6 +1381,22 @@ bool applyModel(String<String<BedRecord<Bed6> > > &bedRecords_sites,
         String<Data> data_replicates;
         resize(data_replicates, length(options.baiFileNames));    
 
+        // reuse read start counts from learning if available
+        String<int> results;
+        resize(results, length(options.baiFileNames), 1, Exact());
+        String<bool> cached;
+        resize(cached, length(options.baiFileNames), false, Exact());
+        for (unsigned rep = 0; rep < length(options.baiFileNames); ++rep)
+            cached[rep] = truncCountCache.get(contigObservationsF[rep], contigObservationsR[rep], results[rep], rep, contigId);
+
+        if (options.streamBam)
+        {
+            SEQAN_OMP_PRAGMA(ordered)
+            for (unsigned rep = 0; rep < length(options.baiFileNames); ++rep)
+                if (!cached[rep])
+                    results[rep] = loadObservations(contigObservationsF[rep], contigObservationsR[rep], contigId, bamStreams[rep], store, options);
+        }
+
         for (unsigned rep = 0; rep < length(options.baiFileNames); ++rep)
         {
             if (options.verbosity >= 1 && length(options.baiFileNames) == 1) std::cout << "Get preprocessed intervals: " << std::endl;
@@ -1099,7 +1404,11 @@ bool applyModel(String<String<BedRecord<Bed6> > > &bedRecords_sites,
             
 
             // for each replicate get preprocessed covered intervals
-            int r = loadObservations(contigObservationsF[rep], contigObservationsR[rep], contigId, options.bamFileNames[rep], baiIndices[rep], store, options);
+            if (options.useTruncCountIndex && !cached[rep])
+                results[rep] = loadObservations(contigObservationsF[rep], contigObservationsR[rep], contigId, truncCountIndices[rep], store, options);
+            else if (!options.streamBam && !cached[rep])
+                results[rep] = loadObservations(contigObservationsF[rep], contigObservationsR[rep], contigId, options.bamFileNames[rep], baiIndices[rep], store, options);
+            int r = results[rep];
             if (r == 1) // error
             {
                 SEQAN_OMP_PRAGMA(critical)
@@ -1112,22 +1421,15 @@ bool applyModel(String<String<BedRecord<Bed6> > > &bedRecords_sites,
             }
             else if (r == 0)
             {
-                String<double> c_contigCovsF;
-                String<double> c_contigCovsR;
-                loadCovariates(c_contigCovsF, c_contigCovsR, contigId, store, options); 
-                String<String<float> > c_contigCovsFimo;
-                String<String<char> > c_motifIds;
-                loadMotifCovariates(c_contigCovsFimo, c_motifIds, contigId, store, options); 
-
                 // Extract covered intervals
                 unsigned i1 = 0;    
-                unsigned i2 = length(store.contigStore[contigId].seq);    
+                unsigned i2 = contigLength(store, contigId);    
                 Data c_data;                
                 resize(c_data.setObs, 2);
                 resize(c_data.setPos, 2);
                 resize(c_data.statePosteriors, 2);
                 resize(c_data.states, 2); 
-                extractCoveredIntervals(c_data, contigObservationsF[rep], contigObservationsR[rep], c_contigCovsF, c_contigCovsR, c_contigCovsFimo, c_motifIds, contigId, i1, i2, options.excludePolyA, options.excludePolyT, false, store, options); 
+                extractCoveredIntervals(c_data, contigObservationsF[rep], contigObservationsR[rep], covariates, contigId, i1, i2, options.excludePolyA, options.excludePolyT, false, store, options); 
 
                 if (!empty(c_data.setObs[0]) || !empty(c_data.setObs[1]))   
                 {
@@ -1182,12 +1484,11 @@ bool doIt(String<ModelParams<TGamma, TBIN> > &modelParams, TOptions &options)
     double timeStamp = sysTime();
 #endif
 
-    typedef  FragmentStore<>    TStore;
-    TStore store;
+    ReferenceStore store;
     if (options.verbosity >= 1) std::cout << "Loading reference ... " << std::endl;
     
     try {
-        if (!loadContigs(store, toCString(options.refFileName)))
+        if (!loadReference(store, options.refFileName))
         {
             std::cerr << "ERROR: Can't load reference sequence from file '" << options.refFileName << "'" << std::endl;
             return 1;
@@ -1198,6 +1499,21 @@ bool doIt(String<ModelParams<TGamma, TBIN> > &modelParams, TOptions &options)
     }
     loadIntervals(options, store);
     loadApplyChrs(options, store);
+    initKernelDensities(options);
+
+    if (options.streamBam)
+    {
+        for (unsigned rep = 0; rep < length(options.bamFileNames); ++rep)
+        {
+            if (!checkContigOrder(options.intervals_contigIds, options.bamFileNames[rep], store) || 
+                    !checkContigOrder(options.applyChr_contigIds, options.bamFileNames[rep], store))
+            {
+                std::cout << "WARNING: Contigs are not given in the same order as in BAM file " << options.bamFileNames[rep] << ". Using BAI index instead of streaming BAM files." << std::endl;
+                options.streamBam = false;
+                break;
+            }
+        }
+    }
 
     setSomeParameters(modelParams, options);
 
@@ -1214,9 +1530,30 @@ bool doIt(String<ModelParams<TGamma, TBIN> > &modelParams, TOptions &options)
         }
     }
 
+    // background signal and motif score covariates
+    Covariates covariates;
+    if (!loadCovariates(covariates, store, options) || !loadMotifCovariates(covariates, store, options))
+        return 1;
+
     // learn model
     String<BamIndex<Bai> > baiIndices;    
-    if (!learnModel(modelParams, baiIndices, inputBaiIndex, store, options))
+    String<TruncCountIndex> truncCountIndices;
+    if (options.useTruncCountIndex)
+    {
+        resize(truncCountIndices, length(options.bamFileNames), Exact());
+        for (unsigned rep = 0; rep < length(options.bamFileNames); ++rep)
+        {
+            if (!openTruncCountIndex(truncCountIndices[rep], options.bamFileNames[rep]))
+                return 1;
+            if (truncCountIndices[rep].selectRead != options.selectRead)
+            {
+                std::cerr << "ERROR: Read start count index " << options.bamFileNames[rep] << " was built with -ur " << truncCountIndices[rep].selectRead << ", please rebuild it or use the same option.\n";
+                return 1;
+            }
+        }
+    }
+    TruncCountCache truncCountCache(length(options.bamFileNames), length(store.contigNameStore), (unsigned long)options.cacheMemory * 1024 * 1024, options.outFileName);
+    if (!learnModel(modelParams, baiIndices, truncCountIndices, inputBaiIndex, covariates, truncCountCache, store, options))
         return 1;
 
 
@@ -1226,7 +1563,7 @@ bool doIt(String<ModelParams<TGamma, TBIN> > &modelParams, TOptions &options)
     resize(bedRecords_sites, length(options.applyChr_contigIds), Exact());
     resize(bedRecords_regions, length(options.applyChr_contigIds), Exact());
     // apply model to whole dataset
-    if (!applyModel(bedRecords_sites, bedRecords_regions, modelParams, baiIndices, inputBaiIndex, store, options))
+    if (!applyModel(bedRecords_sites, bedRecords_regions, modelParams, baiIndices, truncCountIndices, inputBaiIndex, covariates, truncCountCache, store, options))
         return 1;
 
     if (options.verbosity >= 2) std::cout << "Write bedRecords to BED file ... " << options.outFileName << std::endl;
@@ -263,18 +263,18 @@ HMM<TGAMMA, TBIN> merge_HMMs(String<HMM<TGAMMA, TBIN> > &hmms_replicates, String
                 {
                     for (unsigned k = 0; k < 3; ++k)
                     {
-                        mergedHmm.eProbs[s][i][t][k] = 0.0; 
+                        mergedHmm.eProbs[s][i][t*mergedHmm.K + k] = 0.0; 
                         for (unsigned rep = 0; rep < length(hmms_replicates); ++rep)
-                            mergedHmm.eProbs[s][i][t][k] += hmms_replicates[rep].eProbs[s][i][t][k];    // log-space
+                            mergedHmm.eProbs[s][i][t*mergedHmm.K + k] += hmms_replicates[rep].eProbs[s][i][t*mergedHmm.K + k];    // log-space
                     }
                     // for crosslink state
-                    mergedHmm.eProbs[s][i][t][3] = 0.0;
+                    mergedHmm.eProbs[s][i][t*mergedHmm.K + 3] = 0.0;
                     for (unsigned rep = 0; rep < length(hmms_replicates); ++rep)
                     {
 //                         if (options.use_pseudoEProb && hmms_replicates[rep].setObs[s][i].truncCounts[t] == 0)  // add pseudo-count
-//                             mergedHmm.eProbs[s][i][t][3] += hmms_replicates[rep].eProbs[s][i][t][2] * getPseudo_eProb(hmms_replicates[rep].setObs[s][i], t, modelParams[rep].bin2, options);
+//                             mergedHmm.eProbs[s][i][t*mergedHmm.K + 3] += hmms_replicates[rep].eProbs[s][i][t*mergedHmm.K + 2] * getPseudo_eProb(hmms_replicates[rep].setObs[s][i], t, modelParams[rep].bin2, options);
 //                         else
-                        mergedHmm.eProbs[s][i][t][3] += hmms_replicates[rep].eProbs[s][i][t][3];    // log-space
+                        mergedHmm.eProbs[s][i][t*mergedHmm.K + 3] += hmms_replicates[rep].eProbs[s][i][t*mergedHmm.K + 3];    // log-space
                     }
                 }
             }
@@ -54,16 +54,30 @@ class GAMMA  // ignore positions with KDE below theshold
 {
 public:
 
-    GAMMA(double tp_): tp(tp_) {}
-    GAMMA() {}
+    GAMMA(double tp_): tp(tp_), 
+        normB0(std::numeric_limits<double>::quiet_NaN()), normK(std::numeric_limits<double>::quiet_NaN()), normTp(std::numeric_limits<double>::quiet_NaN()) {}
+    GAMMA(): 
+        normB0(std::numeric_limits<double>::quiet_NaN()), normK(std::numeric_limits<double>::quiet_NaN()), normTp(std::numeric_limits<double>::quiet_NaN()) {}
 
     long double getDensity(double const &x);
+    double getLogDensity(double const &x);
+    long double computeLogDensity(double const &x);
+    void computeNormalizer(long double &invTheta, long double &logNormalizer);
+    void getNormalizer(long double &invTheta, long double &logNormalizer);
+    void updateNormalizer();
     bool updateThetaAndK(String<String<String<double> > > &statePosteriors, String<String<Observations> > &setObs, double &kMin, double &kMax, AppOptions const& options); 
     bool updateThetaAndK(String<String<double> > &startSet, String<String<String<double> > > &statePosteriors, String<String<Observations> > &setObs, double &kMin, double &kMax, AppOptions const& options); 
 
     double b0;   // scale parameter
     double k;       // shape parameter 
     double tp;      // truncation point
+
+    // precomputed by updateNormalizer(), only used if parameters did not change afterwards (NaN: not computed)
+    double normB0;
+    double normK;
+    double normTp;
+    long double normInvTheta;       // 1/theta
+    long double logNormalizer;      // log(theta^k * Gamma(k) * (1 - nligf))
 };
 
 
@@ -543,21 +557,68 @@ bool GAMMA::updateThetaAndK(String<String<double> > &startSet,
 ///////////////////////////////////////////////
 
 
-long double GAMMA::getDensity(double const &x)   
+// normalizer of truncated gamma density, depends only on parameters: 
+// log(theta^k * Gamma(k) * (1 - nligf)), in log-space to avoid overflow of theta^k and Gamma(k)
+void GAMMA::computeNormalizer(long double &invTheta, long double &logNormalizer)
 {
-    if (x < this->tp) return 0.0; 
     long double theta = (long double)exp(this->b0)/(long double)this->k;
 
-    long double f1 = pow((long double)x, (long double)this->k - 1.0) * exp(-(long double)x/(long double)theta);
-    long double f2 = pow((long double)theta, (long double)this->k) * tgamma((long double)this->k);
-    
     // normalized lower incomplete gamma function
     long double nligf = boost::math::gamma_p((long double)this->k, (long double)this->tp/(long double)theta);
     if (nligf == 1.0) 
     {
         std::cout << "ERROR: (1 - nligf) is 0! Not set to max. value, should not happen for non-GLM gamma model!" << std::endl;
     } 
-    return  ((f1/f2)/(1.0 - nligf));
+    invTheta = 1.0/theta;
+    logNormalizer = (long double)this->k * log(theta) + lgamma((long double)this->k) + log1p(-nligf);
+}
+
+void GAMMA::getNormalizer(long double &invTheta, long double &logNormalizer)
+{
+    if (this->normB0 == this->b0 && this->normK == this->k && this->normTp == this->tp)
+    {
+        invTheta = this->normInvTheta;
+        logNormalizer = this->logNormalizer;
+        return;
+    }
+    computeNormalizer(invTheta, logNormalizer);
+}
+
+// call after parameter update, before using getLogDensity() in parallel
+void GAMMA::updateNormalizer()
+{
+    computeNormalizer(this->normInvTheta, this->logNormalizer);
+    this->normB0 = this->b0;
+    this->normK = this->k;
+    this->normTp = this->tp;
+}
+
+// log(x^(k-1) * exp(-x/theta) / normalizer), x >= tp
+long double GAMMA::computeLogDensity(double const &x)   
+{
+    long double invTheta;
+    long double logNormalizer;
+    getNormalizer(invTheta, logNormalizer);
+    return ((long double)this->k - 1.0) * log((long double)x) - (long double)x * invTheta - logNormalizer;
+}
+
+// NaN for density 0.0
+double GAMMA::getLogDensity(double const &x)   
+{
+    if (x < this->tp) return std::numeric_limits<double>::quiet_NaN(); 
+    return computeLogDensity(x);
+}
+
+long double GAMMA::getDensity(double const &x)   
+{
+    if (x < this->tp) return 0.0; 
+    return exp(computeLogDensity(x));
+}
+
+void updateNormalizers(GAMMA &gamma)
+{
+    if (!(gamma.normB0 == gamma.b0 && gamma.normK == gamma.k && gamma.normTp == gamma.tp))
+        gamma.updateNormalizer();
 }
 
 
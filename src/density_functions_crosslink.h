@@ -45,17 +45,25 @@ using namespace seqan;
 ////////
 // P = (k-1)/(n-1) ?
 
+// densities for k <= ZTBIN_TABLE_MAX_K, n <= ZTBIN_TABLE_MAX_N are precomputed once per p (most sites), others computed directly
+static const unsigned ZTBIN_TABLE_MAX_K = 16;
+static const unsigned ZTBIN_TABLE_MAX_N = 512;
+
 class ZTBIN
 {
 public:
-    ZTBIN(long double p_): p(p_) {}
-    ZTBIN() {}
+    ZTBIN(long double p_): p(p_), tableP(std::numeric_limits<long double>::quiet_NaN()) {}
+    ZTBIN(): tableP(std::numeric_limits<long double>::quiet_NaN()) {}
  
     long double getDensity(unsigned const &k, unsigned const &n, AppOptions const& options);
+    long double computeDensity(unsigned const &k, unsigned const &n2);
+    void updateDensityTable();
 
     void updateP(String<String<String<double> > > &statePosteriors, String<String<Observations> > &setObs, AppOptions const& options); 
 
     long double p;
+    long double tableP;                 // p the table was computed for (NaN: none)
+    String<long double> densityTable;   // (n - 1) * ZTBIN_TABLE_MAX_K + (k - 1)
 };
 
 
@@ -92,14 +100,24 @@ void ZTBIN::updateP(String<String<String<double> > > &statePosteriors,
 
 
 // k: diagnostic events (de); n: read counts (c)
-long double ZTBIN::getDensity(unsigned const &k, unsigned const &n, AppOptions const&options)
+long double ZTBIN::getDensity(unsigned const &k, unsigned const &n, AppOptions const&/*options*/)
 {
     if (k == 0) return 0.0;     // zero-truncated
 
     unsigned n2 = n;
     unsigned k2 = k;
     n2 = (n2 > k2) ? n2 : k2;          // make sure n >= k      (or limit k?)
-  
+
+    // NOTE: table not used if p was changed afterwards (e.g. swapped)
+    if (k2 <= ZTBIN_TABLE_MAX_K && n2 <= ZTBIN_TABLE_MAX_N && this->tableP == this->p)
+        return this->densityTable[(n2 - 1) * ZTBIN_TABLE_MAX_K + (k2 - 1)];
+
+    return computeDensity(k2, n2);
+}
+
+// n2 >= k2 > 0
+long double ZTBIN::computeDensity(unsigned const &k2, unsigned const &n2)
+{
     // use boost implementation, maybe avoids overflow
     boost::math::binomial_distribution<long double> boostBin;
     boostBin = boost::math::binomial_distribution<long double> ((int)n2, this->p); 
@@ -113,6 +131,22 @@ long double ZTBIN::getDensity(unsigned const &k, unsigned const &n, AppOptions c
     return res * (long double)(1.0/(1.0 - pow((1.0 - this->p), n2)));     // zero-truncated
 }
 
+// precompute densities for current p, call before using getDensity() in parallel
+void ZTBIN::updateDensityTable()
+{
+    resize(this->densityTable, ZTBIN_TABLE_MAX_N * ZTBIN_TABLE_MAX_K, Exact());
+    for (unsigned n = 1; n <= ZTBIN_TABLE_MAX_N; ++n)
+        for (unsigned k = 1; k <= ZTBIN_TABLE_MAX_K; ++k)
+            this->densityTable[(n - 1) * ZTBIN_TABLE_MAX_K + (k - 1)] = computeDensity(k, std::max(n, k));
+    this->tableP = this->p;
+}
+
+void updateDensityTables(ZTBIN &bin)
+{
+    if (bin.tableP != bin.p)
+        bin.updateDensityTable();
+}
+
 // max k?
 // 
 
@@ -257,6 +257,11 @@ bool checkConvergence(ZTBIN_REG &bin1, ZTBIN_REG &bin2, AppOptions &options)
 }
 
 
+// no density table: predicted p differs per position
+void updateDensityTables(ZTBIN_REG &/*bin*/)
+{}
+
+
 void checkOrderBin1Bin2(ZTBIN_REG &bin1, ZTBIN_REG &bin2)
 {
     if (bin1.b0 > bin2.b0)
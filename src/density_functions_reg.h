@@ -56,6 +56,8 @@ public:
     GAMMA_REG() {}
 
     long double getDensity(double const &kde, double const &pred, AppOptions const& options);
+    double getLogDensity(double const &kde, double const &pred, AppOptions const& options);
+    long double computeLogDensity(double const &kde, double const &pred, AppOptions const& options);
     bool updateRegCoeffsAndK(String<String<String<double> > > &statePosteriors, String<String<Observations> > &setObs, double &kMin, double &kMax, AppOptions const& options); 
     bool updateRegCoeffsAndK(String<String<double> > &startSet, String<String<String<double> > > &statePosteriors, String<String<Observations> > &setObs, double &kMin, double &kMax, AppOptions const& options); 
  
@@ -578,15 +580,11 @@ bool GAMMA_REG::updateRegCoeffsAndK(String<String<double> > &startSet,
 /////
 
 
-long double GAMMA_REG::getDensity(double const &kde, double const &pred, AppOptions const&options)   
+// in log-space to avoid overflow of theta^k and Gamma(k), kde >= tp
+long double GAMMA_REG::computeLogDensity(double const &kde, double const &pred, AppOptions const&options)   
 {
-    if (kde < this->tp) return 0.0;
-
     long double theta = (long double)pred/(long double)this->k;
     // if (kde == 0.0) should not occur, checked while computing eProbs
-    long double f1 = pow((long double)kde, (long double)this->k - 1.0) * exp(-(long double)kde/theta);
-    long double f2 = pow(theta, (long double)this->k) * tgamma((long double)this->k);
-    if (f2 ==  0.0) std::cout << "ERROR: f2 is 0!" << std::endl;
 
     // normalized lower incomplete gamma function
     long double nligf = boost::math::gamma_p((long double)this->k, (long double)this->tp/theta);
@@ -597,9 +595,27 @@ long double GAMMA_REG::getDensity(double const &kde, double const &pred, AppOpti
         nligf = options.min_nligf;
     }
 
-    return  ((f1/f2)/(1.0 - nligf));
+    return ((long double)this->k - 1.0) * log((long double)kde) - (long double)kde/theta 
+           - ((long double)this->k * log(theta) + lgamma((long double)this->k) + log1p(-nligf));
+}
+
+// NaN for density 0.0
+double GAMMA_REG::getLogDensity(double const &kde, double const &pred, AppOptions const&options)   
+{
+    if (kde < this->tp) return std::numeric_limits<double>::quiet_NaN();
+    return computeLogDensity(kde, pred, options);
+}
+
+long double GAMMA_REG::getDensity(double const &kde, double const &pred, AppOptions const&options)   
+{
+    if (kde < this->tp) return 0.0;
+    return exp(computeLogDensity(kde, pred, options));
 }
 
+// normalizer depends on predicted mean per position
+void updateNormalizers(GAMMA_REG &/*gamma*/)
+{}
+
 
 
 //////////////////////////
@@ -37,6 +37,20 @@
 using namespace seqan;
 
 
+// transition probabilities in log-space, no. of states known at compile time
+template <unsigned K, typename TValue = long double>
+struct LogTransMatrix
+{
+    TValue values[K][K];
+};
+
+// transition probabilities not in log-space, for scaled forward-backward
+template <unsigned K, typename TValue>
+struct LinTransMatrix
+{
+    TValue values[K][K];
+};
+
 template <typename TGAMMA, typename TBIN>
 class HMM {     
 
@@ -64,9 +78,7 @@ public:
         {
             resize(initProbs[s], length(setObs[s]), Exact());
             resize(eProbs[s], length(setObs[s]), Exact());
-            resize(statePosteriors[s], K, Exact());
-            for (unsigned k = 0; k < K; ++k)
-                resize(statePosteriors[s][k], length(setObs[s]), Exact());
+            init(statePosteriors[s], setObs[s], K);
 
             for (unsigned i = 0; i < length(setObs[s]); ++i)
             {
@@ -76,14 +88,7 @@ public:
                     initProbs[s][i][k] = 1.0/K;
 
                 unsigned T = setObs[s][i].length();
-                resize(eProbs[s][i], T, Exact());
-                for (unsigned k = 0; k < K; ++k)
-                    resize(statePosteriors[s][k][i], T, Exact());
-
-                for (unsigned t = 0; t < T; ++t)
-                {
-                    resize(eProbs[s][i][t], K, Exact());
-                }
+                resize(eProbs[s][i], T * K, Exact());
             }
         }
     }
@@ -94,8 +99,20 @@ public:
     ~HMM<TGAMMA, TBIN>();
     
     bool computeEmissionProbs(ModelParams<TGAMMA, TBIN> &modelParams, bool learning, AppOptions &options);
-    bool iForward(String<String<long double> > &alphas_1, unsigned s, unsigned i, String<String<long double> > &logA, AppOptions &options);    
-    bool iBackward(String<String<long double> > &betas_1, unsigned s, unsigned i, String<String<long double> > &logA, AppOptions &options);    
+    bool computeEmissionProbs(ModelParams<TGAMMA, TBIN> &modelParams, bool learning, bool updateGamma, bool updateBin, AppOptions &options);
+    template <typename TValue>
+    bool iForward(String<TValue> &alphas_1, unsigned s, unsigned i, LogTransMatrix<4, TValue> const &logA, AppOptions &options);    
+    template <typename TValue>
+    bool iBackward(String<TValue> &betas_1, unsigned s, unsigned i, LogTransMatrix<4, TValue> const &logA, AppOptions &options);    
+    template <typename TValue>
+    bool computeStatePosteriorsFBwithPrecision(AppOptions &options);
+    template <typename TValue>
+    bool computeStatePosteriorsFBupdateTransWithPrecision(AppOptions &options);
+    template <typename TValue>
+    bool computeStatePosteriorsFBscaled(bool updateTrans, AppOptions &options);
+    void updateTransMatrix(String<String<long double> > const &p, long double p_2_2, long double p_2_3, AppOptions &options);
+    bool selectStatePosteriorsFB(bool updateTrans, AppOptions &options);
+    bool validateStatePosteriorsFB(bool updateTrans, AppOptions &options);
     bool computeStatePosteriorsFB(AppOptions &options);
     bool computeStatePosteriorsFBupdateTrans(AppOptions &options);
     bool updateTransAndPostProbs(AppOptions &options);
@@ -107,8 +124,11 @@ public:
     void rmBoarderArtifacts(String<String<String<__uint8> > > &states, String<Data> &data_replicates, String<ModelParams<TGAMMA, TBIN> > &modelParams);
 
     // for each F/R,interval,t, state ....
-    String<String<String<String<double> > > > eProbs;           // emission/observation probabilities  P(Y_t | S_t) -> precompute for each t given Y_t = (C_t, T_t) !!!
-    String<String<String<String<double> > > > statePosteriors;  // for each k: for each covered interval string of posteriors
+    String<String<String<double> > >          eProbs;           // emission/observation probabilities  P(Y_t | S_t) -> precompute for each t given Y_t = (C_t, T_t) !!!
+                                                                // for each F/R,interval: T x K values, P(Y_t | S_t = k) at t*K + k
+    String<String<String<double> > >          logGammaDensities; // learning only: cached log-densities of gamma1, gamma2 for each F/R,interval: T x 2 values
+    String<String<String<double> > >          logBinDensities;   // learning only: cached log-densities of bin1, bin2 for each F/R,interval: T x 2 values
+    String<StatePosteriors>                   statePosteriors;  // for each F/R: posteriors of all covered intervals and states
 };
 
 
@@ -116,6 +136,8 @@ template<typename TGAMMA, typename TBIN>
 HMM<TGAMMA, TBIN>::~HMM<TGAMMA, TBIN>()
 {
     clear(this->eProbs);
+    clear(this->logGammaDensities);
+    clear(this->logBinDensities);
     clear(this->statePosteriors);
     clear(this->initProbs);
     clear(this->transMatrix);
@@ -140,7 +162,19 @@ long double myExp(long double x)
 }
 
 // log-sum-exp trick
-long double get_logSumExp(long double &f1, long double &f2, LogSumExp_lookupTable &lookUp)
+long double get_logSumExp(long double &f1, long double &f2, LogSumExp_interpTable const &lookUp)
+{
+    if (std::isnan(f1)) return f2;
+    if (std::isnan(f2)) return f1;
+
+    if (std::isinf(f1)) return f1;
+    if (std::isinf(f2)) return f2;
+
+    return lookUp.logSumExp_add(f1, f2);
+}
+
+// log-sum-exp trick: double precision forward-backward
+inline double get_logSumExp(double f1, double f2, LogSumExp_interpTable const &lookUp)
 {
     if (std::isnan(f1)) return f2;
     if (std::isnan(f2)) return f1;
@@ -152,7 +186,7 @@ long double get_logSumExp(long double &f1, long double &f2, LogSumExp_lookupTabl
 }
 
 // log-sum-exp trick
-long double get_logSumExp_states(long double f1, long double f2, long double f3, long double f4, LogSumExp_lookupTable &lookUp)
+long double get_logSumExp_states(long double f1, long double f2, long double f3, long double f4, LogSumExp_interpTable &lookUp)
 {
     long double sum; 
     sum = get_logSumExp(f1, f2, lookUp);
@@ -162,7 +196,7 @@ long double get_logSumExp_states(long double f1, long double f2, long double f3,
 }
 
 // log-sum-exp trick for string
-long double get_logSumExp(String<long double> &fs, LogSumExp_lookupTable &lookUp)
+long double get_logSumExp(String<long double> &fs, LogSumExp_interpTable &lookUp)
 {   
     long double sum = std::numeric_limits<long double>::quiet_NaN();
 
@@ -173,7 +207,7 @@ long double get_logSumExp(String<long double> &fs, LogSumExp_lookupTable &lookUp
 }
 
 // log-sum-exp trick for String of String
-long double get_logSumExp(String<String<long double> > &fs, LogSumExp_lookupTable &lookUp)
+long double get_logSumExp(String<String<long double> > &fs, LogSumExp_interpTable &lookUp)
 {
     long double sum = std::numeric_limits<long double>::quiet_NaN();
 
@@ -190,76 +224,60 @@ long double get_logSumExp(String<String<long double> > &fs, LogSumExp_lookupTabl
 /////////////////////////////////////////////////////////////////
 
 
-template<typename TEProbs, typename TSetObs>
-bool computeEProb(TEProbs &eProbs, TSetObs &setObs, GAMMA &gamma1, GAMMA &gamma2, ZTBIN &bin1, ZTBIN &bin2, unsigned t, AppOptions &options)
+// log-densities of gamma1 ('non-enriched') and gamma2 ('enriched') for all t of interval: T x 2, NaN for density 0.0
+// NOTE: normalizers precomputed by updateNormalizers(), one log() per position shared by both gammas
+template<typename TSetObs>
+void computeGammaLogDensities(double *logGamma, TSetObs &setObs, GAMMA &gamma1, GAMMA &gamma2, AppOptions &/*options*/)
 {
-    long double gamma1_d = 1.0;
-    long double gamma2_d = 0.0;
-    if (setObs.kdes[t] >= gamma1.tp) 
-    {
-        gamma1_d = gamma1.getDensity(setObs.kdes[t]);
-        gamma2_d = gamma2.getDensity(setObs.kdes[t]); 
-    }
-    long double bin1_d = 1.0;
-    long double bin2_d = 0.0;
-    if (setObs.truncCounts[t] > 0)
+    long double invThetaL1, logNormalizerL1;
+    long double invThetaL2, logNormalizerL2;
+    gamma1.getNormalizer(invThetaL1, logNormalizerL1);
+    gamma2.getNormalizer(invThetaL2, logNormalizerL2);
+    double const invTheta1 = invThetaL1;
+    double const logNormalizer1 = logNormalizerL1;
+    double const invTheta2 = invThetaL2;
+    double const logNormalizer2 = logNormalizerL2;
+    double const k1 = gamma1.k - 1.0;
+    double const k2 = gamma2.k - 1.0;
+    double const tp1 = gamma1.tp;
+    double const tp2 = gamma2.tp;
+    double const nan = std::numeric_limits<double>::quiet_NaN();
+
+    double const *kdes = &setObs.kdes[0];
+    unsigned T = setObs.length();
+    for (unsigned t = 0; t < T; ++t)
     {
-        bin1_d = bin1.getDensity(setObs.truncCounts[t], setObs.nEstimates[t], options);
-        bin2_d = bin2.getDensity(setObs.truncCounts[t], setObs.nEstimates[t], options);
+        double x = kdes[t];
+        double logX = log(x);
+        double logGamma1 = k1 * logX - x * invTheta1 - logNormalizer1;
+        double logGamma2 = k2 * logX - x * invTheta2 - logNormalizer2;
+        logGamma[t*2] = (x >= tp1) ? logGamma1 : 0.0;
+        logGamma[t*2 + 1] = (x >= tp1 && x >= tp2) ? logGamma2 : nan;
     }
-    // log-space
-    eProbs[0] = myLog(gamma1_d) + myLog(bin1_d); 
-    eProbs[1] = myLog(gamma1_d) + myLog(bin2_d);
-    eProbs[2] = myLog(gamma2_d) + myLog(bin1_d);
-    eProbs[3] = myLog(gamma2_d) + myLog(bin2_d);
-
-    // check if valid
-    if ((gamma1_d + gamma2_d == 0.0) || (bin1_d + bin2_d == 0.0) ||
-       (std::isnan(eProbs[0]) && std::isnan(eProbs[1]) && std::isnan(eProbs[2]) && std::isnan(eProbs[3])) )
-    {
-        if (options.verbosity >= 2)
-        {
-            SEQAN_OMP_PRAGMA(critical) 
-                std::cout << "WARNING: emission probabilities 0.0!" << std::endl;
-            SEQAN_OMP_PRAGMA(critical) 
-                std::cout << "       fragment coverage (kde): " << setObs.kdes[t] << std::endl;
-            SEQAN_OMP_PRAGMA(critical) 
-                std::cout << "       read start count: " << (int)setObs.truncCounts[t] << std::endl;
-            SEQAN_OMP_PRAGMA(critical) 
-                std::cout << "       estimated n: " << setObs.nEstimates[t] << std::endl;
-            SEQAN_OMP_PRAGMA(critical) 
-                std::cout << "       emission probability 'non-enriched' gamma: " << gamma1_d << std::endl;
-            SEQAN_OMP_PRAGMA(critical) 
-                std::cout << "       emission probability 'enriched' gamma: " << gamma2_d << std::endl;
-            SEQAN_OMP_PRAGMA(critical) 
-                std::cout << "       emission probability 'non-crosslink' binomial: " << bin1_d << std::endl;
-            SEQAN_OMP_PRAGMA(critical) 
-                std::cout << "       emission probability 'crosslink' binomial: " << bin2_d << std::endl;
-        }
-        eProbs[0] = 0.0;
-        eProbs[1] = std::numeric_limits<double>::quiet_NaN();
-        eProbs[2] = std::numeric_limits<double>::quiet_NaN();
-        eProbs[3] = std::numeric_limits<double>::quiet_NaN();
-        return false;
-    } 
-    return true;
 }
 
-template<typename TEProbs, typename TSetObs>
-bool computeEProb(TEProbs &eProbs, TSetObs &setObs, GAMMA_REG &gamma1, GAMMA_REG &gamma2, ZTBIN &bin1, ZTBIN &bin2, unsigned t, AppOptions &options)
+template<typename TSetObs>
+void computeGammaLogDensities(double *logGamma, TSetObs &setObs, GAMMA_REG &gamma1, GAMMA_REG &gamma2, AppOptions &options)
 {
-    long double x = std::max(setObs.rpkms[t], options.minRPKMtoFit);
-    long double gamma1_pred = exp(gamma1.b0 + gamma1.b1 * x);
-    long double gamma2_pred = exp(gamma2.b0 + gamma2.b1 * x);
-
-    long double gamma1_d = 1.0;
-    long double gamma2_d = 0.0;
-    if (setObs.kdes[t] >= gamma1.tp) 
+    for (unsigned t = 0; t < setObs.length(); ++t)
     {
-        gamma1_d = gamma1.getDensity(setObs.kdes[t], gamma1_pred, options);
-        gamma2_d = gamma2.getDensity(setObs.kdes[t], gamma2_pred, options); 
+        logGamma[t*2] = 0.0;
+        logGamma[t*2 + 1] = std::numeric_limits<double>::quiet_NaN();
+        if (setObs.kdes[t] >= gamma1.tp) 
+        {
+            long double x = std::max(setObs.rpkms[t], options.minRPKMtoFit);
+            long double gamma1_pred = exp(gamma1.b0 + gamma1.b1 * x);
+            long double gamma2_pred = exp(gamma2.b0 + gamma2.b1 * x);
+            logGamma[t*2] = gamma1.getLogDensity(setObs.kdes[t], gamma1_pred, options);
+            logGamma[t*2 + 1] = gamma2.getLogDensity(setObs.kdes[t], gamma2_pred, options); 
+        }
     }
+}
 
+// log-densities of bin1 ('non-crosslink') and bin2 ('crosslink') at t, NaN for density 0.0
+template<typename TSetObs>
+void computeBinLogDensities(double *logBin, TSetObs &setObs, ZTBIN &bin1, ZTBIN &bin2, unsigned t, AppOptions &options)
+{
     long double bin1_d = 1.0;
     long double bin2_d = 0.0;
     if (setObs.truncCounts[t] > 0)
@@ -267,56 +285,13 @@ bool computeEProb(TEProbs &eProbs, TSetObs &setObs, GAMMA_REG &gamma1, GAMMA_REG
         bin1_d = bin1.getDensity(setObs.truncCounts[t], setObs.nEstimates[t], options);
         bin2_d = bin2.getDensity(setObs.truncCounts[t], setObs.nEstimates[t], options);
     }
-    // log-space
-    eProbs[0] = myLog(gamma1_d) + myLog(bin1_d); 
-    eProbs[1] = myLog(gamma1_d) + myLog(bin2_d);
-    eProbs[2] = myLog(gamma2_d) + myLog(bin1_d);
-    eProbs[3] = myLog(gamma2_d) + myLog(bin2_d);
-
-    // 
-    if ((gamma1_d + gamma2_d == 0.0) || (bin1_d + bin2_d == 0.0) ||
-            (std::isnan(eProbs[0]) && std::isnan(eProbs[1]) && std::isnan(eProbs[2]) && std::isnan(eProbs[3])) )
-    {
-        if (options.verbosity >= 2)
-        {
-            SEQAN_OMP_PRAGMA(critical) 
-                std::cout << "WARNING: emission probabilities going against 0.0!" << std::endl;
-            SEQAN_OMP_PRAGMA(critical) 
-                std::cout << "       fragment coverage (kde): " << setObs.kdes[t] << std::endl;
-            SEQAN_OMP_PRAGMA(critical) 
-                std::cout << "       read start count: " << (int)setObs.truncCounts[t] << std::endl;
-            SEQAN_OMP_PRAGMA(critical) 
-                std::cout << "       estimated n: " << setObs.nEstimates[t] << std::endl;
-            SEQAN_OMP_PRAGMA(critical) 
-                std::cout << "       covariate b: " << x << " predicted mean 'non-enriched': " << gamma1_pred << " predicted mean 'enriched': " << gamma2_pred << std::endl;
-            SEQAN_OMP_PRAGMA(critical) 
-                std::cout << "       emission probability 'non-enriched' gamma: " << gamma1_d << std::endl;
-            SEQAN_OMP_PRAGMA(critical) 
-                std::cout << "       emission probability 'enriched' gamma: " << gamma2_d << std::endl;
-            SEQAN_OMP_PRAGMA(critical) 
-                std::cout << "       emission probability 'non-crosslink' binomial: " << bin1_d << std::endl;
-            SEQAN_OMP_PRAGMA(critical) 
-                std::cout << "       emission probability 'crosslink' binomial: " << bin2_d << std::endl;
-        }    
-        eProbs[0] = 0.0;
-        eProbs[1] = std::numeric_limits<double>::quiet_NaN();
-        eProbs[2] = std::numeric_limits<double>::quiet_NaN();
-        eProbs[3] = std::numeric_limits<double>::quiet_NaN();
-        return false;
-    }
-    return true;
+    logBin[0] = myLog(bin1_d);
+    logBin[1] = myLog(bin2_d);
 }
 
-template<typename TEProbs, typename TSetObs>
-bool computeEProb(TEProbs &eProbs, TSetObs &setObs, GAMMA &gamma1, GAMMA &gamma2, ZTBIN_REG &bin1, ZTBIN_REG &bin2, unsigned t, AppOptions &options)
+template<typename TSetObs>
+void computeBinLogDensities(double *logBin, TSetObs &setObs, ZTBIN_REG &bin1, ZTBIN_REG &bin2, unsigned t, AppOptions &options)
 {
-    long double gamma1_d = 1.0;
-    long double gamma2_d = 0.0;
-    if (setObs.kdes[t] >= gamma1.tp) 
-    {
-        gamma1_d = gamma1.getDensity(setObs.kdes[t]);
-        gamma2_d = gamma2.getDensity(setObs.kdes[t]); 
-    }
     unsigned mId = setObs.motifIds[t];
     long double bin1_pred = 1.0/(1.0+exp(-bin1.b0 - bin1.regCoeffs[mId]*setObs.fimoScores[t]));
     long double bin2_pred = 1.0/(1.0+exp(-bin2.b0 - bin2.regCoeffs[mId]*setObs.fimoScores[t]));
@@ -328,110 +303,74 @@ bool computeEProb(TEProbs &eProbs, TSetObs &setObs, GAMMA &gamma1, GAMMA &gamma2
         bin1_d = bin1.getDensity(setObs.truncCounts[t], setObs.nEstimates[t], bin1_pred, options);
         bin2_d = bin2.getDensity(setObs.truncCounts[t], setObs.nEstimates[t], bin2_pred, options);
     }
-
-    eProbs[0] = myLog(gamma1_d) + myLog(bin1_d);
-    eProbs[1] = myLog(gamma1_d) + myLog(bin2_d);
-    eProbs[2] = myLog(gamma2_d) + myLog(bin1_d);
-    eProbs[3] = myLog(gamma2_d) + myLog(bin2_d);
-
-    //
-    if ((gamma1_d + gamma2_d == 0.0) || (bin1_d + bin2_d == 0.0) ||
-            (std::isnan(eProbs[0]) && std::isnan(eProbs[1]) && std::isnan(eProbs[2]) && std::isnan(eProbs[3])) )
-    {
-        if (options.verbosity >= 2)
-        {
-            SEQAN_OMP_PRAGMA(critical) 
-                std::cout << "WARNING: emission probabilities going against 0.0!" << std::endl;
-            SEQAN_OMP_PRAGMA(critical) 
-                std::cout << "       fragment coverage (kde): " << setObs.kdes[t] << std::endl;
-            SEQAN_OMP_PRAGMA(critical) 
-                std::cout << "       read start count: " << (int)setObs.truncCounts[t] << std::endl;
-            SEQAN_OMP_PRAGMA(critical) 
-                std::cout << "       estimated n: " << setObs.nEstimates[t] << std::endl;
-            SEQAN_OMP_PRAGMA(critical) 
-                std::cout << "       covariate x: " << setObs.fimoScores[t] << std::endl;
-            SEQAN_OMP_PRAGMA(critical) 
-                std::cout << "       emission probability 'non-enriched' gamma: " << gamma1_d << std::endl;
-            SEQAN_OMP_PRAGMA(critical) 
-                std::cout << "       emission probability 'enriched' gamma: " << gamma2_d << std::endl;
-            SEQAN_OMP_PRAGMA(critical) 
-                std::cout << "       emission probability 'non-crosslink' binomial: " << bin1_d << std::endl;
-            SEQAN_OMP_PRAGMA(critical) 
-                std::cout << "       emission probability 'crosslink' binomial: " << bin2_d << std::endl;
-        }
-        eProbs[0] = 0.0;
-        eProbs[1] = std::numeric_limits<double>::quiet_NaN();
-        eProbs[2] = std::numeric_limits<double>::quiet_NaN();
-        eProbs[3] = std::numeric_limits<double>::quiet_NaN();
-        return false;
-    }
-    return true;
+    logBin[0] = myLog(bin1_d);
+    logBin[1] = myLog(bin2_d);
 }
 
-template<typename TEProbs, typename TSetObs>
-bool computeEProb(TEProbs &eProbs, TSetObs &setObs, GAMMA_REG &gamma1, GAMMA_REG &gamma2, ZTBIN_REG &bin1, ZTBIN_REG &bin2, unsigned t, AppOptions &options)
+// covariates at t for warnings
+template<typename TSetObs>
+void printCovariates(TSetObs &/*setObs*/, GAMMA &/*gamma1*/, GAMMA &/*gamma2*/, unsigned /*t*/, AppOptions &/*options*/)
+{}
+
+template<typename TSetObs>
+void printCovariates(TSetObs &setObs, GAMMA_REG &gamma1, GAMMA_REG &gamma2, unsigned t, AppOptions &options)
 {
     long double x = std::max(setObs.rpkms[t], options.minRPKMtoFit);
-    long double gamma1_pred = exp(gamma1.b0 + gamma1.b1 * x);
-    long double gamma2_pred = exp(gamma2.b0 + gamma2.b1 * x);
+    SEQAN_OMP_PRAGMA(critical) 
+        std::cout << "       covariate b: " << x << " predicted mean 'non-enriched': " << exp(gamma1.b0 + gamma1.b1 * x) << " predicted mean 'enriched': " << exp(gamma2.b0 + gamma2.b1 * x) << std::endl;
+}
 
-    long double gamma1_d = 1.0;
-    long double gamma2_d = 0.0;
-    if (setObs.kdes[t] >= gamma1.tp) 
-    {
-        gamma1_d = gamma1.getDensity(setObs.kdes[t], gamma1_pred, options);
-        gamma2_d = gamma2.getDensity(setObs.kdes[t], gamma2_pred, options); 
-    }
-    unsigned mId = setObs.motifIds[t];
-    long double bin1_pred = 1.0/(1.0+exp(-bin1.b0 - bin1.regCoeffs[mId]*setObs.fimoScores[t]));
-    long double bin2_pred = 1.0/(1.0+exp(-bin2.b0 - bin2.regCoeffs[mId]*setObs.fimoScores[t]));
+template<typename TSetObs>
+void printCovariates(TSetObs &/*setObs*/, ZTBIN &/*bin1*/, ZTBIN &/*bin2*/, unsigned /*t*/, AppOptions &/*options*/)
+{}
 
-    long double bin1_d = 1.0;
-    long double bin2_d = 0.0;
-    if (setObs.truncCounts[t] > 0)
-    {
-        bin1_d = bin1.getDensity(setObs.truncCounts[t], setObs.nEstimates[t], bin1_pred, options);
-        bin2_d = bin2.getDensity(setObs.truncCounts[t], setObs.nEstimates[t], bin2_pred, options);
-    }
+template<typename TSetObs>
+void printCovariates(TSetObs &setObs, ZTBIN_REG &/*bin1*/, ZTBIN_REG &/*bin2*/, unsigned t, AppOptions &/*options*/)
+{
+    SEQAN_OMP_PRAGMA(critical) 
+        std::cout << "       covariate x: " << setObs.fimoScores[t] << std::endl;
+}
 
-    eProbs[0] = myLog(gamma1_d) + myLog(bin1_d);
-    eProbs[1] = myLog(gamma1_d) + myLog(bin2_d);
-    eProbs[2] = myLog(gamma2_d) + myLog(bin1_d);
-    eProbs[3] = myLog(gamma2_d) + myLog(bin2_d);
 
-    // 
-    if ((gamma1_d + gamma2_d == 0.0) || (bin1_d + bin2_d == 0.0) ||
-            (std::isnan(eProbs[0]) && std::isnan(eProbs[1]) && std::isnan(eProbs[2]) && std::isnan(eProbs[3])) )
+// emission probabilities at t from log-densities of gamma and binomial (log-space)
+template<typename TEProbs, typename TSetObs, typename TGAMMA, typename TBIN>
+bool computeEProb(TEProbs &eProbs, double const *logGamma, double const *logBin, TSetObs &setObs, TGAMMA &gamma1, TGAMMA &gamma2, TBIN &bin1, TBIN &bin2, unsigned t, AppOptions &options)
+{
+    eProbs[0] = logGamma[0] + logBin[0]; 
+    eProbs[1] = logGamma[0] + logBin[1];
+    eProbs[2] = logGamma[1] + logBin[0];
+    eProbs[3] = logGamma[1] + logBin[1];
+
+    // check if valid: both gamma or both binomial densities 0.0 (all emission probabilities 0.0)
+    if ((std::isnan(logGamma[0]) && std::isnan(logGamma[1])) || (std::isnan(logBin[0]) && std::isnan(logBin[1])))
     {
         if (options.verbosity >= 2)
         {
             SEQAN_OMP_PRAGMA(critical) 
-                std::cout << "WARNING: emission probabilities going against 0.0!" << std::endl;
+                std::cout << "WARNING: emission probabilities 0.0!" << std::endl;
             SEQAN_OMP_PRAGMA(critical) 
                 std::cout << "       fragment coverage (kde): " << setObs.kdes[t] << std::endl;
             SEQAN_OMP_PRAGMA(critical) 
                 std::cout << "       read start count: " << (int)setObs.truncCounts[t] << std::endl;
             SEQAN_OMP_PRAGMA(critical) 
                 std::cout << "       estimated n: " << setObs.nEstimates[t] << std::endl;
+            printCovariates(setObs, gamma1, gamma2, t, options);
+            printCovariates(setObs, bin1, bin2, t, options);
             SEQAN_OMP_PRAGMA(critical) 
-                std::cout << "       covariate b: " << x << " predicted mean 'non-enriched': " << gamma1_pred << " predicted mean 'enriched': " << gamma2_pred << std::endl;
+                std::cout << "       emission probability 'non-enriched' gamma: " << myExp(logGamma[0]) << std::endl;
             SEQAN_OMP_PRAGMA(critical) 
-                std::cout << "       covariate x: " << setObs.fimoScores[t] << std::endl;
+                std::cout << "       emission probability 'enriched' gamma: " << myExp(logGamma[1]) << std::endl;
             SEQAN_OMP_PRAGMA(critical) 
-                std::cout << "       emission probability 'non-enriched' gamma: " << gamma1_d << std::endl;
+                std::cout << "       emission probability 'non-crosslink' binomial: " << myExp(logBin[0]) << std::endl;
             SEQAN_OMP_PRAGMA(critical) 
-                std::cout << "       emission probability 'enriched' gamma: " << gamma2_d << std::endl;
-            SEQAN_OMP_PRAGMA(critical) 
-                std::cout << "       emission probability 'non-crosslink' binomial: " << bin1_d << std::endl;
-            SEQAN_OMP_PRAGMA(critical) 
-                std::cout << "       emission probability 'crosslink' binomial: " << bin2_d << std::endl;
+                std::cout << "       emission probability 'crosslink' binomial: " << myExp(logBin[1]) << std::endl;
         }
         eProbs[0] = 0.0;
         eProbs[1] = std::numeric_limits<double>::quiet_NaN();
         eProbs[2] = std::numeric_limits<double>::quiet_NaN();
         eProbs[3] = std::numeric_limits<double>::quiet_NaN();
         return false;
-    }
+    } 
     return true;
 }
 
@@ -439,69 +378,138 @@ bool computeEProb(TEProbs &eProbs, TSetObs &setObs, GAMMA_REG &gamma1, GAMMA_REG
 template<typename TGAMMA, typename TBIN>
 bool HMM<TGAMMA, TBIN>::computeEmissionProbs(ModelParams<TGAMMA, TBIN> &modelParams, bool learning, AppOptions &options)
 {
+    return computeEmissionProbs(modelParams, learning, true, true, options);
+}
+
+
+// learning: gamma and binomial log-densities are cached, only recomputed if their parameters changed (updateGamma, updateBin)
+template<typename TGAMMA, typename TBIN>
+bool HMM<TGAMMA, TBIN>::computeEmissionProbs(ModelParams<TGAMMA, TBIN> &modelParams, bool learning, bool updateGamma, bool updateBin, AppOptions &options)
+{
+    if (!learning)
+    {
+        updateGamma = true;
+        updateBin = true;
+    }
+    else if (empty(this->logGammaDensities))
+    {
+        resize(this->logGammaDensities, 2, Exact());
+        resize(this->logBinDensities, 2, Exact());
+        for (unsigned s = 0; s < 2; ++s)
+        {
+            resize(this->logGammaDensities[s], length(this->setObs[s]), Exact());
+            resize(this->logBinDensities[s], length(this->setObs[s]), Exact());
+            for (unsigned i = 0; i < length(this->setObs[s]); ++i)
+            {
+                resize(this->logGammaDensities[s][i], this->setObs[s][i].length() * 2, Exact());
+                resize(this->logBinDensities[s][i], this->setObs[s][i].length() * 2, Exact());
+            }
+        }
+        updateGamma = true;
+        updateBin = true;
+    }
+    // NOTE: not learning, normalizers are updated before in applyModel()
+    if (learning && updateGamma)
+    {
+        updateNormalizers(modelParams.gamma1);
+        updateNormalizers(modelParams.gamma2);
+    }
+    // NOTE: not learning, modelParams are shared by threads applying the model, tables are updated before in applyModel()
+    if (learning && updateBin)
+    {
+        updateDensityTables(modelParams.bin1);
+        updateDensityTables(modelParams.bin2);
+    }
+
     bool stop = false;
     for (unsigned s = 0; s < 2; ++s)
     {
 #if HMM_PARALLEL
-        SEQAN_OMP_PRAGMA(parallel for schedule(dynamic, 1)) 
+        SEQAN_OMP_PRAGMA(parallel)
 #endif  
-        for (unsigned i = 0; i < length(this->setObs[s]); ++i)
         {
-            bool discardInterval = false;
-            for (unsigned t = 0; t < this->setObs[s][i].length(); ++t)  
+            String<double> logGammaTmp;     // not learning: per thread, reused for all intervals
+#if HMM_PARALLEL
+            SEQAN_OMP_PRAGMA(for schedule(dynamic, 1)) 
+#endif  
+            for (unsigned i = 0; i < length(this->setObs[s]); ++i)
             {
-                if (this->setObs[s][i].kdes[t] == 0.0)
+                double *logGammaI;
+                if (learning)
                 {
-                    std::cerr << "ERROR: KDE is 0.0 at i " << i << " t: " << t << std::endl;
-                    SEQAN_OMP_PRAGMA(critical) 
-                    stop = true;
+                    logGammaI = &this->logGammaDensities[s][i][0];
                 }
-
-                if (!computeEProb(this->eProbs[s][i][t], this->setObs[s][i], modelParams.gamma1, modelParams.gamma2, modelParams.bin1, modelParams.bin2, t, options))
+                else
                 {
-                    SEQAN_OMP_PRAGMA(critical) 
-                    discardInterval = true;
+                    resize(logGammaTmp, this->setObs[s][i].length() * 2);
+                    logGammaI = &logGammaTmp[0];
                 }
-            }
-            if (learning && discardInterval)
-            {
-                SEQAN_OMP_PRAGMA(critical) 
-                std::cout << "ERROR: Emission probability became 0.0! This might be due to artifacts or outliers." << std::endl;
-                SEQAN_OMP_PRAGMA(critical)
-                if (options.verbosity >= 2)
-                {
-                    if (s == 0) 
-                        std::cout << " Interval: [" << (this->setPos[s][i]) << ", " << (this->setPos[s][i] + this->setObs[s][i].length()) << ") on forward strand." << std::endl;
-                    else 
-                        std::cout << " Interval: [" << (this->contigLength - this->setPos[s][i] - 1) << ", " << (this->contigLength - this->setPos[s][i] - 1 + this->setObs[s][i].length()) << ") on reverse strand." << std::endl;
-                }
-                stop = true;
-                if (!options.useHighPrecision)  // TODO ?
+                if (updateGamma)
+                    computeGammaLogDensities(logGammaI, this->setObs[s][i], modelParams.gamma1, modelParams.gamma2, options);
+
+                bool discardInterval = false;
+                for (unsigned t = 0; t < this->setObs[s][i].length(); ++t)  
                 {
-                    SEQAN_OMP_PRAGMA(critical) 
-                    std::cout << "NOTE: Try running PureCLIP in high floating-point precision mode (long double, parameter '-ld')." << std::endl;
+                    if (this->setObs[s][i].kdes[t] == 0.0)
+                    {
+                        std::cerr << "ERROR: KDE is 0.0 at i " << i << " t: " << t << std::endl;
+                        SEQAN_OMP_PRAGMA(critical) 
+                        stop = true;
+                    }
+
+                    double logBin_t[2];
+                    double *logGamma = logGammaI + t*2;
+                    double *logBin = (learning) ? &this->logBinDensities[s][i][t*2] : logBin_t;
+                    if (updateBin)
+                        computeBinLogDensities(logBin, this->setObs[s][i], modelParams.bin1, modelParams.bin2, t, options);
+
+                    double *eProbs_t = &this->eProbs[s][i][t*K];     // P(Y_t | S_t = k) for all k
+                    if (!computeEProb(eProbs_t, logGamma, logBin, this->setObs[s][i], modelParams.gamma1, modelParams.gamma2, modelParams.bin1, modelParams.bin2, t, options))
+                    {
+                        SEQAN_OMP_PRAGMA(critical) 
+                        discardInterval = true;
+                    }
                 }
-            }
-            else if (!learning && discardInterval) 
-            {
-                this->setObs[s][i].discard = true;
-                SEQAN_OMP_PRAGMA(critical) 
-                std::cout << "Warning: discarding interval on forward strand due to emission probabilities of 0.0 (set to state 'non-enriched + non-crosslink')." << std::endl;
-                if (options.verbosity >= 2)
+                if (learning && discardInterval)
                 {
                     SEQAN_OMP_PRAGMA(critical) 
-                    if (s == 0) 
-                        std::cout << " Interval [" << (this->setPos[s][i]) << ", " << (this->setPos[s][i] + this->setObs[s][i].length()) << ") on forward strand. " << std::endl;
-                    else 
-                        std::cout << " Interval [" << (this->contigLength - this->setPos[s][i] - 1) << ", " << (this->contigLength - this->setPos[s][i] - 1 + this->setObs[s][i].length()) << ") on reverse strand." << std::endl;
+                    std::cout << "ERROR: Emission probability became 0.0! This might be due to artifacts or outliers." << std::endl;
+                    SEQAN_OMP_PRAGMA(critical)
+                    if (options.verbosity >= 2)
+                    {
+                        if (s == 0) 
+                            std::cout << " Interval: [" << (this->setPos[s][i]) << ", " << (this->setPos[s][i] + this->setObs[s][i].length()) << ") on forward strand." << std::endl;
+                        else 
+                            std::cout << " Interval: [" << (this->contigLength - this->setPos[s][i] - 1) << ", " << (this->contigLength - this->setPos[s][i] - 1 + this->setObs[s][i].length()) << ") on reverse strand." << std::endl;
+                    }
+                    stop = true;
+                    if (!options.useHighPrecision)  // TODO ?
+                    {
+                        SEQAN_OMP_PRAGMA(critical) 
+                        std::cout << "NOTE: Try running PureCLIP in high floating-point precision mode (long double, parameter '-ld')." << std::endl;
+                    }
                 }
-                if (!options.useHighPrecision)  // TODO ?
+                else if (!learning && discardInterval) 
                 {
+                    this->setObs[s][i].discard = true;
                     SEQAN_OMP_PRAGMA(critical) 
-                    std::cout << "NOTE: If this happens frequently, rerun PureCLIP in high floating-point precision mode (long double, parameter '-ld')." << std::endl;
+                    std::cout << "Warning: discarding interval on forward strand due to emission probabilities of 0.0 (set to state 'non-enriched + non-crosslink')." << std::endl;
+                    if (options.verbosity >= 2)
+                    {
+                        SEQAN_OMP_PRAGMA(critical) 
+                        if (s == 0) 
+                            std::cout << " Interval [" << (this->setPos[s][i]) << ", " << (this->setPos[s][i] + this->setObs[s][i].length()) << ") on forward strand. " << std::endl;
+                        else 
+                            std::cout << " Interval [" << (this->contigLength - this->setPos[s][i] - 1) << ", " << (this->contigLength - this->setPos[s][i] - 1 + this->setObs[s][i].length()) << ") on reverse strand." << std::endl;
+                    }
+                    if (!options.useHighPrecision)  // TODO ?
+                    {
+                        SEQAN_OMP_PRAGMA(critical) 
+                        std::cout << "NOTE: If this happens frequently, rerun PureCLIP in high floating-point precision mode (long double, parameter '-ld')." << std::endl;
+                    }
                 }
-            }
-        }   
+            }   
+        }
     }
     if (stop) return false;
     return true;
@@ -513,41 +521,72 @@ bool HMM<TGAMMA, TBIN>::computeEmissionProbs(ModelParams<TGAMMA, TBIN> &modelPar
 // forward-backward algorithm parts
 /////////////////////////////////////////////////////////////////
 
-// for one interval only
-// Forward-algorithm: log-space
-template<typename TGAMMA, typename TBIN>
-bool HMM<TGAMMA, TBIN>::iForward(String<String<long double> > &alphas_1, unsigned s, unsigned i, String<String<long double> > &logA, AppOptions &options)
+// forward and backward values of one interval (T x K, log-space), kept per thread and reused for all intervals
+// TValue: long double with '-ld', double otherwise
+template <typename TValue>
+struct FBScratch
 {
-    // NOTE
-    // in log-space: alphas_1, eProbs
-    // trans. probs, init porbs, state post. probs. not in log-space
+    String<TValue> alphas_1;
+    String<TValue> betas_1;
+    String<TValue> eProbsLin;   // scaled forward-backward only: emission probs. not in log-space, divided by max. per position
+    String<TValue> scales;      // scaled forward-backward only: normalization factors c_t
+};
 
-    // for t = 1
-    for (unsigned k = 0; k < this->K; ++k)
+
+template <unsigned K, typename TValue>
+void setLogTransMatrix(LogTransMatrix<K, TValue> &logA, String<String<long double> > const &transMatrix)
+{
+    for (unsigned k_1 = 0; k_1 < K; ++k_1)
+        for (unsigned k_2 = 0; k_2 < K; ++k_2)
+            logA.values[k_1][k_2] = log(transMatrix[k_1][k_2]);
+}
+
+// log-sum-exp over states: without checks if all values are finite (common case), 
+// otherwise same as get_logSumExp() for each state
+template <unsigned K, typename TValue>
+inline TValue get_logSumExp_states(TValue const (&fs)[K], LogSumExp_interpTable const &lookUp)
+{
+    bool finite = true;
+    for (unsigned k = 0; k < K; ++k)
+        finite &= std::isfinite(fs[k]);
+    if (finite)
+        return lookUp.logSumExp_states(fs);
+
+    TValue sum = fs[0];
+    for (unsigned k = 1; k < K; ++k)
     {
-        alphas_1[0][k] = myLog(this->initProbs[s][i][k]) + this->eProbs[s][i][0][k];    // log ? initProbs should not become 0.0!
+        TValue f = fs[k];
+        sum = get_logSumExp(sum, f, lookUp);
     }
+    return sum;
+}
+
+// Forward-algorithm for one interval: log-space
+// alphas_1, eProbs: T x K, logInitProbs: K
+template <unsigned K, typename TValue>
+bool forwardLog(TValue *alphas_1, double const *eProbs, TValue const *logInitProbs, LogTransMatrix<K, TValue> const &logA, unsigned T, LogSumExp_interpTable const &lookUp)
+{
+    // for t = 1
+    for (unsigned k = 0; k < K; ++k)
+        alphas_1[k] = logInitProbs[k] + eProbs[k];    // log ? initProbs should not become 0.0!
 
     // for t = 2:T
-    for (unsigned t = 1; t < this->setObs[s][i].length(); ++t)
+    for (unsigned t = 1; t < T; ++t)
     {
-        for (unsigned k = 0; k < this->K; ++k)
+        TValue const *alphasPrev = alphas_1 + (t-1)*K;
+        for (unsigned k = 0; k < K; ++k)
         { 
-            long double f1 = alphas_1[t-1][0] + logA[0][k] + this->eProbs[s][i][t][k];
-            long double f2 = alphas_1[t-1][1] + logA[1][k] + this->eProbs[s][i][t][k];
-            long double f3 = alphas_1[t-1][2] + logA[2][k] + this->eProbs[s][i][t][k];
-            long double f4 = alphas_1[t-1][3] + logA[3][k] + this->eProbs[s][i][t][k];
+            TValue fs[K];
+            for (unsigned k_1 = 0; k_1 < K; ++k_1)
+                fs[k_1] = alphasPrev[k_1] + logA.values[k_1][k] + eProbs[t*K + k];
 
-            alphas_1[t][k] = get_logSumExp_states(f1, f2, f3, f4, options.lookUp);
+            alphas_1[t*K + k] = get_logSumExp_states(fs, lookUp);
 
-            if (std::isinf(alphas_1[t][k]))
+            if (std::isinf(alphas_1[t*K + k]))
             {
-                std::cout << "ERROR: alphas_1[" << t << "][" << k << "] is " << alphas_1[t][k] << std::endl;
-                std::cout << "       f1 " << f1 << " f2 " << f2 << " f3 " << f3 << " f4 " << f4 << std::endl;
-                std::cout << "       alphas_1[t-1][0] " << alphas_1[t-1][0] << " logA[0][k] " << logA[0][k] << " this->eProbs[s][i][t][k] " << this->eProbs[s][i][t][k] << std::endl;
-                std::cout << "       alphas_1[t-1][1] " << alphas_1[t-1][1] << " logA[1][k] " << logA[1][k] << " this->eProbs[s][i][t][k] " << this->eProbs[s][i][t][k] << std::endl;
-                std::cout << "       alphas_1[t-1][2] " << alphas_1[t-1][2] << " logA[2][k] " << logA[2][k] << " this->eProbs[s][i][t][k] " << this->eProbs[s][i][t][k] << std::endl;
-                std::cout << "       alphas_1[t-1][3] " << alphas_1[t-1][3] << " logA[3][k] " << logA[3][k] << " this->eProbs[s][i][t][k] " << this->eProbs[s][i][t][k] << std::endl;
+                std::cout << "ERROR: alphas_1[" << t << "][" << k << "] is " << alphas_1[t*K + k] << std::endl;
+                for (unsigned k_1 = 0; k_1 < K; ++k_1)
+                    std::cout << "       alphas_1[t-1][" << k_1 << "] " << alphasPrev[k_1] << " logA[" << k_1 << "][k] " << logA.values[k_1][k] << " eProbs[t][k] " << eProbs[t*K + k] << std::endl;
                 return false;
             }
         }
@@ -555,32 +594,31 @@ bool HMM<TGAMMA, TBIN>::iForward(String<String<long double> > &alphas_1, unsigne
     return true;
 }
 
-
-// Backward-algorithm: log-space
-template<typename TGAMMA, typename TBIN>
-bool HMM<TGAMMA, TBIN>::iBackward(String<String<long double> > &betas_1, unsigned s, unsigned i, String<String<long double> > &logA, AppOptions &options)
+// Backward-algorithm for one interval: log-space
+template <unsigned K, typename TValue>
+bool backwardLog(TValue *betas_1, double const *eProbs, LogTransMatrix<K, TValue> const &logA, unsigned T, LogSumExp_interpTable const &lookUp)
 {
-    unsigned T = this->setObs[s][i].length();
     // for t = T
-    for (unsigned k = 0; k < this->K; ++k)
-       betas_1[this->setObs[s][i].length() - 1][k] = log(1.0);
+    for (unsigned k = 0; k < K; ++k)
+       betas_1[(T - 1)*K + k] = log(1.0);
     
     // for t = 2:T
-    for (int t = this->setObs[s][i].length() - 2; t >= 0; --t)
+    for (int t = T - 2; t >= 0; --t)
     {
-        for (unsigned k = 0; k < this->K; ++k)
+        TValue const *betasNext = betas_1 + (t+1)*K;
+        double const *eProbsNext = eProbs + (t+1)*K;
+        for (unsigned k = 0; k < K; ++k)
         {
             // sum over following states
-            long double f1 = betas_1[t+1][0] + logA[k][0] + this->eProbs[s][i][t+1][0];
-            long double f2 = betas_1[t+1][1] + logA[k][1] + this->eProbs[s][i][t+1][1];
-            long double f3 = betas_1[t+1][2] + logA[k][2] + this->eProbs[s][i][t+1][2];
-            long double f4 = betas_1[t+1][3] + logA[k][3] + this->eProbs[s][i][t+1][3];
+            TValue fs[K];
+            for (unsigned k_2 = 0; k_2 < K; ++k_2)
+                fs[k_2] = betasNext[k_2] + logA.values[k][k_2] + eProbsNext[k_2];
 
-            betas_1[t][k] = get_logSumExp_states(f1, f2, f3, f4, options.lookUp);
+            betas_1[t*K + k] = get_logSumExp_states(fs, lookUp);
 
-            if (std::isinf(betas_1[t][k]))
+            if (std::isinf(betas_1[t*K + k]))
             {
-                std::cout << "ERROR: betas_1[" << t << "][" << k << "] is " << betas_1[t][k] << std::endl;
+                std::cout << "ERROR: betas_1[" << t << "][" << k << "] is " << betas_1[t*K + k] << std::endl;
                 return false;
             }
         }
@@ -589,143 +627,125 @@ bool HMM<TGAMMA, TBIN>::iBackward(String<String<long double> > &betas_1, unsigne
 }
 
 
-// for log-space
-// interval-wise to avoid storing alpha_1 and beta_1 values for whole genome
-// TODO learn 2-> 2/3 only above threshold !?
-template<typename TGAMMA, typename TBIN>
-bool HMM<TGAMMA, TBIN>::computeStatePosteriorsFBupdateTrans(AppOptions &options)
+// Emission probabilities of one interval not in log-space for scaled forward-backward
+// NOTE: divided by max. over states per position (cancels out in state posteriors and xi values), avoids underflow
+template <unsigned K, typename TValue>
+void setEProbsLin(TValue *eProbsLin, double const *eProbs, unsigned T)
 {
-    String<String<long double> > logA = this->transMatrix;
-    for (unsigned k_1 = 0; k_1 < this->K; ++k_1)
-        for (unsigned k_2 = 0; k_2 < this->K; ++k_2)
-            logA[k_1][k_2] = log(this->transMatrix[k_1][k_2]);
- 
-    String<String<long double> > p;
-    resize(p, this->K, Exact());
-    for (unsigned k_1 = 0; k_1 < this->K; ++k_1)
+    for (unsigned t = 0; t < T; ++t)
     {
-        SEQAN_OMP_PRAGMA(critical)
-        resize(p[k_1], this->K, Exact());
-        for (unsigned k_2 = 0; k_2 < this->K; ++k_2)
-            p[k_1][k_2] = 0.0;
+        double maxEProb = -std::numeric_limits<double>::infinity();
+        for (unsigned k = 0; k < K; ++k)
+            if (eProbs[t*K + k] > maxEProb) maxEProb = eProbs[t*K + k];     // NaN: probability 0.0
+
+        for (unsigned k = 0; k < K; ++k)
+            eProbsLin[t*K + k] = (std::isinf(maxEProb)) ? 0.0 : myExp(eProbs[t*K + k] - maxEProb);
     }
-    long double p_2_2 = 0.0;     // for separate learning of trans. prob from '2' -> '2'
-    long double p_2_3 = 0.0;     // for separate learning of trans. prob from '2' -> '3'               
+}
 
-    for (unsigned s = 0; s < 2; ++s)
+// Forward-algorithm for one interval: scaled probabilities (Rabiner), alphas normalized to sum 1 per position
+// alphas, eProbsLin: T x K, scales: T
+template <unsigned K, typename TValue>
+bool forwardScaled(TValue *alphas, TValue *scales, TValue const *eProbsLin, TValue const *initProbs, LinTransMatrix<K, TValue> const &A, unsigned T)
+{
+    for (unsigned t = 0; t < T; ++t)
     {
-        bool stop = false;
-#if HMM_PARALLEL
-        SEQAN_OMP_PRAGMA(parallel for schedule(dynamic, 1))
-#endif  
-        for (unsigned i = 0; i < length(this->setObs[s]); ++i)
+        TValue *alphasCur = alphas + t*K;
+        if (t == 0)
         {
-            unsigned T = setObs[s][i].length();
-            // forward probabilities
-            String<String<long double> > alphas_1;
-            resize(alphas_1, T, Exact());
-            for (unsigned t = 0; t < T; ++t)
-            {
-                resize(alphas_1[t], this->K, Exact());
-            }
-            if (!iForward(alphas_1, s, i, logA, options))
-            {
-                stop = true;
-                continue;
-            }
-
-            // backward probabilities  
-            String<String<long double> > betas_1;
-            resize(betas_1, T, Exact());
-            for (unsigned t = 0; t < T; ++t)
-                resize(betas_1[t], this->K, Exact());
+            for (unsigned k = 0; k < K; ++k)
+                alphasCur[k] = initProbs[k];
+        }
+        else
+        {
+            // 4x4 matrix-vector product
+            TValue const *alphasPrev = alphas + (t-1)*K;
+            for (unsigned k = 0; k < K; ++k)
+                alphasCur[k] = 0.0;
+            for (unsigned k_1 = 0; k_1 < K; ++k_1)
+                for (unsigned k = 0; k < K; ++k)
+                    alphasCur[k] += alphasPrev[k_1] * A.values[k_1][k];
+        }
 
-            if (!iBackward(betas_1, s, i, logA, options))
-            {
-                stop = true;
-                continue;
-            }
-           
-            // compute state posterior probabilities
-            for (unsigned t = 0; t < this->setObs[s][i].length(); ++t)
-            {
-                long double f1 = alphas_1[t][0] + betas_1[t][0];
-                long double f2 = alphas_1[t][1] + betas_1[t][1];
-                long double f3 = alphas_1[t][2] + betas_1[t][2];
-                long double f4 = alphas_1[t][3] + betas_1[t][3];
+        TValue c = 0.0;
+        for (unsigned k = 0; k < K; ++k)
+        {
+            alphasCur[k] *= eProbsLin[t*K + k];
+            c += alphasCur[k];
+        }
+        if (!(c > 0.0) || std::isinf(c))
+        {
+            std::cout << "ERROR: scaling factor of alphas[" << t << "] is " << c << std::endl;
+            return false;
+        }
+        scales[t] = c;
+        for (unsigned k = 0; k < K; ++k)
+            alphasCur[k] /= c;
+    }
+    return true;
+}
 
-                long double norm = get_logSumExp_states(f1, f2, f3, f4, options.lookUp);
+// Backward-algorithm for one interval: scaled probabilities, using scaling factors of forward-algorithm
+template <unsigned K, typename TValue>
+bool backwardScaled(TValue *betas, TValue const *scales, TValue const *eProbsLin, LinTransMatrix<K, TValue> const &A, unsigned T)
+{
+    for (unsigned k = 0; k < K; ++k)
+        betas[(T - 1)*K + k] = 1.0;
 
-                for (unsigned k = 0; k < this->K; ++k)
-                {
-                    this->statePosteriors[s][k][i][t] = myExp(alphas_1[t][k] + betas_1[t][k] - norm);     // store not in log-space!
- 
-                    if (std::isnan(this->statePosteriors[s][k][i][t]) || std::isinf(this->statePosteriors[s][k][i][t]) || 
-                        this->statePosteriors[s][k][i][t] < 0.0 || this->statePosteriors[s][k][i][t] > 1.0) 
-                    {
-                        std::cout << "ERROR: state posterior probability is " << this->statePosteriors[s][k][i][t] << "." << std::endl;
-                        std::cout << "       s: " << s << " i: " << i << " t: " << t << " k:" << k << std::endl;
-                        std::cout << "       alphas_1[t][k]: " << alphas_1[t][k] << " betas_1[t][k]: " << betas_1[t][k] << " norm: " << norm << std::endl;
-                        stop = true;
-                        continue;
-                    }
-                }
-            }
+    for (int t = T - 2; t >= 0; --t)
+    {
+        TValue next[K];
+        for (unsigned k_2 = 0; k_2 < K; ++k_2)
+            next[k_2] = eProbsLin[(t+1)*K + k_2] * betas[(t+1)*K + k_2] / scales[t+1];
 
-            // update initial probabilities
-            for (unsigned k = 0; k < this->K; ++k)
-                this->initProbs[s][i][k] = this->statePosteriors[s][k][i][0]; 
+        for (unsigned k = 0; k < K; ++k)
+        {
+            TValue sum = 0.0;
+            for (unsigned k_2 = 0; k_2 < K; ++k_2)
+                sum += A.values[k][k_2] * next[k_2];
+            betas[t*K + k] = sum;
 
-            // compute xi values for interval in preparation for new trans. probs
-            String<String<long double> > xis;
-            resize(xis, this->K, Exact());
-            String<String<long double> > p_i;
-            resize(p_i, this->K, Exact());
-            for (unsigned k_1 = 0; k_1 < this->K; ++k_1)   
-            {
-                resize(xis[k_1], this->K, 0.0, Exact());
-                resize(p_i[k_1], this->K, 0.0, Exact());
-            }
-            long double p_2_2_i = 0.0;
-            long double p_2_3_i = 0.0;
-            // 
-            for (unsigned t = 1; t < this->setObs[s][i].length(); ++t)
+            if (std::isinf(sum) || std::isnan(sum))
             {
-                long double norm = std::numeric_limits<long double>::quiet_NaN();
-                for (unsigned k_1 = 0; k_1 < this->K; ++k_1)
-                {
-                    for (unsigned k_2 = 0; k_2 < this->K; ++k_2)
-                    {
-                        xis[k_1][k_2] = alphas_1[t-1][k_1] + logA[k_1][k_2] + this->eProbs[s][i][t][k_2] + betas_1[t][k_2];
-                        norm = get_logSumExp(norm, xis[k_1][k_2], options.lookUp);
-                    }
-                }
-                for (unsigned k_1 = 0; k_1 < this->K; ++k_1)
-                    for (unsigned k_2 = 0; k_2 < this->K; ++k_2)
-                        p_i[k_1][k_2] += myExp(xis[k_1][k_2] - norm);
-
-                // learn p[2->2/3] for region over nThresholdForP
-                if (options.nThresholdForTransP > 0 && setObs[s][i].nEstimates[t] >= options.nThresholdForTransP)
-                {
-                    p_2_2_i += myExp(xis[2][2] - norm);
-                    p_2_3_i += myExp(xis[2][3] - norm);
-                }
+                std::cout << "ERROR: betas[" << t << "][" << k << "] is " << sum << std::endl;
+                return false;
             }
-            // add to global sum
-            for (unsigned k_1 = 0; k_1 < this->K; ++k_1) 
-                for (unsigned k_2 = 0; k_2 < this->K; ++k_2)
-                    SEQAN_OMP_PRAGMA(critical)
-                        p[k_1][k_2] += p_i[k_1][k_2];
-            
-            SEQAN_OMP_PRAGMA(critical)
-                p_2_2 += p_2_2_i;
-            SEQAN_OMP_PRAGMA(critical)
-                p_2_3 += p_2_3_i;
         }
-        if (stop) return false;
     }
+    return true;
+}
+
 
-    // update transition matrix
+// for one interval only
+// Forward-algorithm: log-space
+template<typename TGAMMA, typename TBIN>
+template<typename TValue>
+bool HMM<TGAMMA, TBIN>::iForward(String<TValue> &alphas_1, unsigned s, unsigned i, LogTransMatrix<4, TValue> const &logA, AppOptions &options)
+{
+    // NOTE
+    // in log-space: alphas_1, eProbs
+    // trans. probs, init porbs, state post. probs. not in log-space
+    TValue logInitProbs[4];
+    for (unsigned k = 0; k < 4; ++k)
+        logInitProbs[k] = myLog(this->initProbs[s][i][k]);
+
+    return forwardLog(&alphas_1[0], &this->eProbs[s][i][0], logInitProbs, logA, this->setObs[s][i].length(), options.lookUp);
+}
+
+
+// Backward-algorithm: log-space
+template<typename TGAMMA, typename TBIN>
+template<typename TValue>
+bool HMM<TGAMMA, TBIN>::iBackward(String<TValue> &betas_1, unsigned s, unsigned i, LogTransMatrix<4, TValue> const &logA, AppOptions &options)
+{
+    return backwardLog(&betas_1[0], &this->eProbs[s][i][0], logA, this->setObs[s][i].length(), options.lookUp);
+}
+
+
+// new transition probabilities from expected no. of transitions p (summed xi values)
+template<typename TGAMMA, typename TBIN>
+void HMM<TGAMMA, TBIN>::updateTransMatrix(String<String<long double> > const &p, long double p_2_2, long double p_2_3, AppOptions &options)
+{
     String<String<long double> > A = this->transMatrix;
     for (unsigned k_1 = 0; k_1 < this->K; ++k_1)
     {
@@ -755,80 +775,441 @@ bool HMM<TGAMMA, TBIN>::computeStatePosteriorsFBupdateTrans(AppOptions &options)
         std::cout << "NOTE: Prevented transition probability '2' -> '3' from dropping below min. value of " << options.minTransProbCS << ". Set for transitions '2' -> '3' (and if necessary also for '3'->'3') to " << options.minTransProbCS << "." << std::endl;
     }
     this->transMatrix = A;
-    return true;
 }
 
 
-// without updating transition probabilities: log space
+// for log-space
+// interval-wise to avoid storing alpha_1 and beta_1 values for whole genome
+// TODO learn 2-> 2/3 only above threshold !?
 template<typename TGAMMA, typename TBIN>
-bool HMM<TGAMMA, TBIN>::computeStatePosteriorsFB(AppOptions &options)
+template<typename TValue>
+bool HMM<TGAMMA, TBIN>::computeStatePosteriorsFBupdateTransWithPrecision(AppOptions &options)
 {
-    String<String<long double> > logA = this->transMatrix;
+    SEQAN_ASSERT_EQ(this->K, 4u);       // forward-backward kernels specialized for 4 states
+    LogTransMatrix<4, TValue> logA;
+    setLogTransMatrix(logA, this->transMatrix);
+ 
+    String<String<long double> > p;
+    resize(p, this->K, Exact());
     for (unsigned k_1 = 0; k_1 < this->K; ++k_1)
+    {
+        SEQAN_OMP_PRAGMA(critical)
+        resize(p[k_1], this->K, Exact());
         for (unsigned k_2 = 0; k_2 < this->K; ++k_2)
-            logA[k_1][k_2] = log(this->transMatrix[k_1][k_2]);
+            p[k_1][k_2] = 0.0;
+    }
+    long double p_2_2 = 0.0;     // for separate learning of trans. prob from '2' -> '2'
+    long double p_2_3 = 0.0;     // for separate learning of trans. prob from '2' -> '3'               
 
     for (unsigned s = 0; s < 2; ++s)
     {
         bool stop = false;
+        unsigned maxT = 0;
+        for (unsigned i = 0; i < length(this->setObs[s]); ++i)
+            maxT = std::max(maxT, this->setObs[s][i].length());
 #if HMM_PARALLEL
-        SEQAN_OMP_PRAGMA(parallel for schedule(dynamic, 1)) 
+        SEQAN_OMP_PRAGMA(parallel)
 #endif  
-        for (unsigned i = 0; i < length(this->setObs[s]); ++i)
         {
-            unsigned T = setObs[s][i].length();
-            // forward probabilities
-            String<String<long double> > alphas_1;
-            resize(alphas_1, T, Exact());
-            for (unsigned t = 0; t < T; ++t)
-            {
-                resize(alphas_1[t], this->K, Exact());
-            }
-            if (!iForward(alphas_1, s, i, logA, options))
+            FBScratch<TValue> scratch;      // per thread, reused for all intervals
+            reserve(scratch.alphas_1, maxT * this->K, Exact());
+            reserve(scratch.betas_1, maxT * this->K, Exact());
+#if HMM_PARALLEL
+            SEQAN_OMP_PRAGMA(for schedule(dynamic, 1))
+#endif  
+            for (unsigned i = 0; i < length(this->setObs[s]); ++i)
             {
-                stop = true;
-                continue;
+                unsigned T = setObs[s][i].length();
+                // forward probabilities
+                String<TValue> &alphas_1 = scratch.alphas_1;
+                resize(alphas_1, T * this->K);
+                if (!iForward(alphas_1, s, i, logA, options))
+                {
+                    stop = true;
+                    continue;
+                }
+
+                // backward probabilities  
+                String<TValue> &betas_1 = scratch.betas_1;
+                resize(betas_1, T * this->K);
+                if (!iBackward(betas_1, s, i, logA, options))
+                {
+                    stop = true;
+                    continue;
+                }
+           
+                // compute state posterior probabilities
+                for (unsigned t = 0; t < this->setObs[s][i].length(); ++t)
+                {
+                    TValue fs[4];
+                    for (unsigned k = 0; k < 4; ++k)
+                        fs[k] = alphas_1[t*4 + k] + betas_1[t*4 + k];
+
+                    TValue norm = get_logSumExp_states(fs, options.lookUp);
+
+                    for (unsigned k = 0; k < this->K; ++k)
+                    {
+                        double &postProb = statePosterior(this->statePosteriors[s], i, t, k);
+                        postProb = myExp(alphas_1[t*4 + k] + betas_1[t*4 + k] - norm);     // store not in log-space!
+ 
+                        if (std::isnan(postProb) || std::isinf(postProb) || postProb < 0.0 || postProb > 1.0) 
+                        {
+                            std::cout << "ERROR: state posterior probability is " << postProb << "." << std::endl;
+                            std::cout << "       s: " << s << " i: " << i << " t: " << t << " k:" << k << std::endl;
+                            std::cout << "       alphas_1[t][k]: " << alphas_1[t*4 + k] << " betas_1[t][k]: " << betas_1[t*4 + k] << " norm: " << norm << std::endl;
+                            stop = true;
+                            continue;
+                        }
+                    }
+                }
+
+                // update initial probabilities
+                for (unsigned k = 0; k < this->K; ++k)
+                    this->initProbs[s][i][k] = statePosterior(this->statePosteriors[s], i, 0, k); 
+
+                // compute xi values for interval in preparation for new trans. probs
+                TValue xis[4][4];
+                long double p_i[4][4] = {{0.0}};
+                long double p_2_2_i = 0.0;
+                long double p_2_3_i = 0.0;
+                double const *eProbs_i = &this->eProbs[s][i][0];
+                for (unsigned t = 1; t < this->setObs[s][i].length(); ++t)
+                {
+                    TValue norm = std::numeric_limits<TValue>::quiet_NaN();
+                    for (unsigned k_1 = 0; k_1 < 4; ++k_1)
+                    {
+                        for (unsigned k_2 = 0; k_2 < 4; ++k_2)
+                        {
+                            xis[k_1][k_2] = alphas_1[(t-1)*4 + k_1] + logA.values[k_1][k_2] + eProbs_i[t*4 + k_2] + betas_1[t*4 + k_2];
+                            norm = get_logSumExp(norm, xis[k_1][k_2], options.lookUp);
+                        }
+                    }
+                    for (unsigned k_1 = 0; k_1 < 4; ++k_1)
+                        for (unsigned k_2 = 0; k_2 < 4; ++k_2)
+                            p_i[k_1][k_2] += myExp(xis[k_1][k_2] - norm);
+
+                    // learn p[2->2/3] for region over nThresholdForP
+                    if (options.nThresholdForTransP > 0 && setObs[s][i].nEstimates[t] >= options.nThresholdForTransP)
+                    {
+                        p_2_2_i += myExp(xis[2][2] - norm);
+                        p_2_3_i += myExp(xis[2][3] - norm);
+                    }
+                }
+                // add to global sum
+                for (unsigned k_1 = 0; k_1 < this->K; ++k_1) 
+                    for (unsigned k_2 = 0; k_2 < this->K; ++k_2)
+                        SEQAN_OMP_PRAGMA(critical)
+                            p[k_1][k_2] += p_i[k_1][k_2];
+            
+                SEQAN_OMP_PRAGMA(critical)
+                    p_2_2 += p_2_2_i;
+                SEQAN_OMP_PRAGMA(critical)
+                    p_2_3 += p_2_3_i;
             }
+        }
+        if (stop) return false;
+    }
 
-            // backward probabilities
-            String<String<long double> > betas_1;
-            resize(betas_1, T, Exact());
-            for (unsigned t = 0; t < T; ++t)
-                resize(betas_1[t], this->K, Exact());
-            if (!iBackward(betas_1, s, i, logA, options))
+    updateTransMatrix(p, p_2_2, p_2_3, options);
+    return true;
+}
+
+
+// without updating transition probabilities: log space
+template<typename TGAMMA, typename TBIN>
+template<typename TValue>
+bool HMM<TGAMMA, TBIN>::computeStatePosteriorsFBwithPrecision(AppOptions &options)
+{
+    SEQAN_ASSERT_EQ(this->K, 4u);       // forward-backward kernels specialized for 4 states
+    LogTransMatrix<4, TValue> logA;
+    setLogTransMatrix(logA, this->transMatrix);
+
+    for (unsigned s = 0; s < 2; ++s)
+    {
+        bool stop = false;
+        unsigned maxT = 0;
+        for (unsigned i = 0; i < length(this->setObs[s]); ++i)
+            maxT = std::max(maxT, this->setObs[s][i].length());
+#if HMM_PARALLEL
+        SEQAN_OMP_PRAGMA(parallel)
+#endif  
+        {
+            FBScratch<TValue> scratch;      // per thread, reused for all intervals
+            reserve(scratch.alphas_1, maxT * this->K, Exact());
+            reserve(scratch.betas_1, maxT * this->K, Exact());
+#if HMM_PARALLEL
+            SEQAN_OMP_PRAGMA(for schedule(dynamic, 1))
+#endif  
+            for (unsigned i = 0; i < length(this->setObs[s]); ++i)
             {
-                stop = true;
-                continue;
-            }
+                unsigned T = setObs[s][i].length();
+                // forward probabilities
+                String<TValue> &alphas_1 = scratch.alphas_1;
+                resize(alphas_1, T * this->K);
+                if (!iForward(alphas_1, s, i, logA, options))
+                {
+                    stop = true;
+                    continue;
+                }
+
+                // backward probabilities
+                String<TValue> &betas_1 = scratch.betas_1;
+                resize(betas_1, T * this->K);
+                if (!iBackward(betas_1, s, i, logA, options))
+                {
+                    stop = true;
+                    continue;
+                }
  
-            // compute state posterior probabilities (in log-space)
-            for (unsigned t = 0; t < this->setObs[s][i].length(); ++t)
-            {
-                long double f1 = alphas_1[t][0] + betas_1[t][0];
-                long double f2 = alphas_1[t][1] + betas_1[t][1];
-                long double f3 = alphas_1[t][2] + betas_1[t][2];
-                long double f4 = alphas_1[t][3] + betas_1[t][3];
+                // compute state posterior probabilities (in log-space)
+                for (unsigned t = 0; t < this->setObs[s][i].length(); ++t)
+                {
+                    TValue fs[4];
+                    for (unsigned k = 0; k < 4; ++k)
+                        fs[k] = alphas_1[t*4 + k] + betas_1[t*4 + k];
+
+                    TValue norm = get_logSumExp_states(fs, options.lookUp);
 
-                long double norm = get_logSumExp_states(f1, f2, f3, f4, options.lookUp);
+                    for (unsigned k = 0; k < this->K; ++k)
+                    {
+                        statePosterior(this->statePosteriors[s], i, t, k) = myExp(alphas_1[t*4 + k] + betas_1[t*4 + k] - norm);     // store not in log-space!
+                        if (std::isnan(statePosterior(this->statePosteriors[s], i, t, k))) std::cout << "ERROR: statePosterior is nan! " << std::endl;
+                    }
+                }
 
+                // update init probs
                 for (unsigned k = 0; k < this->K; ++k)
+                    this->initProbs[s][i][k] = statePosterior(this->statePosteriors[s], i, 0, k);
+
+            }
+        }
+        if (stop) return false;
+    }
+    return true;
+}
+
+
+// scaled forward-backward (not in log-space), with or without updating transition probabilities
+template<typename TGAMMA, typename TBIN>
+template<typename TValue>
+bool HMM<TGAMMA, TBIN>::computeStatePosteriorsFBscaled(bool updateTrans, AppOptions &options)
+{
+    SEQAN_ASSERT_EQ(this->K, 4u);       // forward-backward kernels specialized for 4 states
+    LinTransMatrix<4, TValue> A;
+    for (unsigned k_1 = 0; k_1 < 4; ++k_1)
+        for (unsigned k_2 = 0; k_2 < 4; ++k_2)
+            A.values[k_1][k_2] = this->transMatrix[k_1][k_2];
+
+    long double p[4][4] = {{0.0}};
+    long double p_2_2 = 0.0;     // for separate learning of trans. prob from '2' -> '2'
+    long double p_2_3 = 0.0;     // for separate learning of trans. prob from '2' -> '3'
+
+    for (unsigned s = 0; s < 2; ++s)
+    {
+        bool stop = false;
+        unsigned maxT = 0;
+        for (unsigned i = 0; i < length(this->setObs[s]); ++i)
+            maxT = std::max(maxT, this->setObs[s][i].length());
+#if HMM_PARALLEL
+        SEQAN_OMP_PRAGMA(parallel)
+#endif  
+        {
+            FBScratch<TValue> scratch;      // per thread, reused for all intervals
+            reserve(scratch.alphas_1, maxT * this->K, Exact());
+            reserve(scratch.betas_1, maxT * this->K, Exact());
+            reserve(scratch.eProbsLin, maxT * this->K, Exact());
+            reserve(scratch.scales, maxT, Exact());
+#if HMM_PARALLEL
+            SEQAN_OMP_PRAGMA(for schedule(dynamic, 1))
+#endif  
+            for (unsigned i = 0; i < length(this->setObs[s]); ++i)
+            {
+                unsigned T = setObs[s][i].length();
+                resize(scratch.alphas_1, T * this->K);
+                resize(scratch.betas_1, T * this->K);
+                resize(scratch.eProbsLin, T * this->K);
+                resize(scratch.scales, T);
+                TValue *alphas = &scratch.alphas_1[0];
+                TValue *betas = &scratch.betas_1[0];
+                TValue const *eProbsLin = &scratch.eProbsLin[0];
+
+                setEProbsLin<4>(&scratch.eProbsLin[0], &this->eProbs[s][i][0], T);
+                TValue initProbs[4];
+                for (unsigned k = 0; k < 4; ++k)
+                    initProbs[k] = this->initProbs[s][i][k];
+
+                if (!forwardScaled(alphas, &scratch.scales[0], eProbsLin, initProbs, A, T) ||
+                    !backwardScaled(betas, &scratch.scales[0], eProbsLin, A, T))
                 {
-                    this->statePosteriors[s][k][i][t] = myExp(alphas_1[t][k] + betas_1[t][k] - norm);     // store not in log-space!
-                    if (std::isnan(this->statePosteriors[s][k][i][t])) std::cout << "ERROR: statePosterior is nan! " << std::endl;
+                    SEQAN_OMP_PRAGMA(critical)
+                    std::cout << "       s: " << s << " i: " << i << std::endl;
+                    stop = true;
+                    continue;
                 }
-            }
 
-            // update init probs
-            for (unsigned k = 0; k < this->K; ++k)
-                this->initProbs[s][i][k] = this->statePosteriors[s][k][i][0];
+                // compute state posterior probabilities
+                for (unsigned t = 0; t < T; ++t)
+                {
+                    TValue norm = 0.0;
+                    for (unsigned k = 0; k < 4; ++k)
+                        norm += alphas[t*4 + k] * betas[t*4 + k];
+
+                    for (unsigned k = 0; k < 4; ++k)
+                    {
+                        double &postProb = statePosterior(this->statePosteriors[s], i, t, k);
+                        postProb = alphas[t*4 + k] * betas[t*4 + k] / norm;
+
+                        if (std::isnan(postProb) || std::isinf(postProb) || postProb < 0.0 || postProb > 1.0) 
+                        {
+                            std::cout << "ERROR: state posterior probability is " << postProb << "." << std::endl;
+                            std::cout << "       s: " << s << " i: " << i << " t: " << t << " k:" << k << std::endl;
+                            stop = true;
+                        }
+                    }
+                }
+
+                // update initial probabilities
+                for (unsigned k = 0; k < this->K; ++k)
+                    this->initProbs[s][i][k] = statePosterior(this->statePosteriors[s], i, 0, k); 
+
+                if (!updateTrans)
+                    continue;
+
+                // compute xi values for interval in preparation for new trans. probs
+                TValue xis[4][4];
+                long double p_i[4][4] = {{0.0}};
+                long double p_2_2_i = 0.0;
+                long double p_2_3_i = 0.0;
+                for (unsigned t = 1; t < T; ++t)
+                {
+                    TValue norm = 0.0;
+                    for (unsigned k_1 = 0; k_1 < 4; ++k_1)
+                    {
+                        for (unsigned k_2 = 0; k_2 < 4; ++k_2)
+                        {
+                            xis[k_1][k_2] = alphas[(t-1)*4 + k_1] * A.values[k_1][k_2] * eProbsLin[t*4 + k_2] * betas[t*4 + k_2];
+                            norm += xis[k_1][k_2];
+                        }
+                    }
+                    for (unsigned k_1 = 0; k_1 < 4; ++k_1)
+                        for (unsigned k_2 = 0; k_2 < 4; ++k_2)
+                            p_i[k_1][k_2] += xis[k_1][k_2] / norm;
 
+                    // learn p[2->2/3] for region over nThresholdForP
+                    if (options.nThresholdForTransP > 0 && setObs[s][i].nEstimates[t] >= options.nThresholdForTransP)
+                    {
+                        p_2_2_i += xis[2][2] / norm;
+                        p_2_3_i += xis[2][3] / norm;
+                    }
+                }
+                // add to global sum
+                SEQAN_OMP_PRAGMA(critical)
+                {
+                    for (unsigned k_1 = 0; k_1 < 4; ++k_1) 
+                        for (unsigned k_2 = 0; k_2 < 4; ++k_2)
+                            p[k_1][k_2] += p_i[k_1][k_2];
+                    p_2_2 += p_2_2_i;
+                    p_2_3 += p_2_3_i;
+                }
+            }
         }
         if (stop) return false;
     }
+
+    if (updateTrans)
+    {
+        String<String<long double> > pStr;
+        resize(pStr, this->K, Exact());
+        for (unsigned k_1 = 0; k_1 < this->K; ++k_1)
+        {
+            resize(pStr[k_1], this->K, Exact());
+            for (unsigned k_2 = 0; k_2 < this->K; ++k_2)
+                pStr[k_1][k_2] = p[k_1][k_2];
+        }
+        updateTransMatrix(pStr, p_2_2, p_2_3, options);
+    }
     return true;
 }
 
 
+// forward-backward as selected: log-space or scaled ('-sfb'), long double only if '-ld' is set
+template<typename TGAMMA, typename TBIN>
+bool HMM<TGAMMA, TBIN>::selectStatePosteriorsFB(bool updateTrans, AppOptions &options)
+{
+    if (options.scaledFB)
+    {
+        if (options.useHighPrecision)
+            return computeStatePosteriorsFBscaled<long double>(updateTrans, options);
+        return computeStatePosteriorsFBscaled<double>(updateTrans, options);
+    }
+    if (updateTrans)
+    {
+        if (options.useHighPrecision)
+            return computeStatePosteriorsFBupdateTransWithPrecision<long double>(options);
+        return computeStatePosteriorsFBupdateTransWithPrecision<double>(options);
+    }
+    if (options.useHighPrecision)
+        return computeStatePosteriorsFBwithPrecision<long double>(options);
+    return computeStatePosteriorsFBwithPrecision<double>(options);
+}
+
+
+// run forward-backward in log-space and long double (reference) and as selected on the same parameters,
+// report max. deviation of state posteriors (and trans. probs) and keep results of selected run
+template<typename TGAMMA, typename TBIN>
+bool HMM<TGAMMA, TBIN>::validateStatePosteriorsFB(bool updateTrans, AppOptions &options)
+{
+    String<String<String<long double> > > initProbs = this->initProbs;
+    String<String<long double> > transMatrix = this->transMatrix;
+
+    bool ok = (updateTrans) ? computeStatePosteriorsFBupdateTransWithPrecision<long double>(options) : computeStatePosteriorsFBwithPrecision<long double>(options);
+    if (!ok) return false;
+    String<StatePosteriors> refStatePosteriors = this->statePosteriors;
+    String<String<long double> > refTransMatrix = this->transMatrix;
+
+    this->initProbs = initProbs;
+    this->transMatrix = transMatrix;
+    if (!selectStatePosteriorsFB(updateTrans, options))
+        return false;
+
+    double maxDev = 0.0;
+    for (unsigned s = 0; s < 2; ++s)
+        for (unsigned j = 0; j < length(this->statePosteriors[s].values); ++j)
+            maxDev = std::max(maxDev, std::fabs(this->statePosteriors[s].values[j] - refStatePosteriors[s].values[j]));
+    long double maxDevTrans = 0.0;
+    for (unsigned k_1 = 0; k_1 < this->K; ++k_1)
+        for (unsigned k_2 = 0; k_2 < this->K; ++k_2)
+            maxDevTrans = std::max(maxDevTrans, std::fabs(this->transMatrix[k_1][k_2] - refTransMatrix[k_1][k_2]));
+
+    SEQAN_OMP_PRAGMA(critical)
+    {
+        std::cout << "Forward-backward validation (" << ((options.scaledFB) ? "scaled" : "log-space") << ", " << ((options.useHighPrecision) ? "long double" : "double") 
+                  << " vs. log-space, long double): max. deviation of state posterior probabilities: " << maxDev;
+        if (updateTrans)
+            std::cout << ", transition probabilities: " << maxDevTrans;
+        std::cout << std::endl;
+    }
+    return true;
+}
+
+
+template<typename TGAMMA, typename TBIN>
+bool HMM<TGAMMA, TBIN>::computeStatePosteriorsFBupdateTrans(AppOptions &options)
+{
+    if (options.validateFB)
+        return validateStatePosteriorsFB(true, options);
+    return selectStatePosteriorsFB(true, options);
+}
+
+
+template<typename TGAMMA, typename TBIN>
+bool HMM<TGAMMA, TBIN>::computeStatePosteriorsFB(AppOptions &options)
+{
+    if (options.validateFB)
+        return validateStatePosteriorsFB(false, options);
+    return selectStatePosteriorsFB(false, options);
+}
+
 
 bool updateDensityParams2(String<String<String<double> > > &statePosteriors1, String<String<String<double> > > &statePosteriors2, String<String<Observations> > &setObs, 
                           GAMMA &gamma1, GAMMA &gamma2, 
@@ -876,16 +1257,16 @@ bool HMM<TGAMMA, TBIN>::updateDensityParams(TGAMMA &gamma1, TGAMMA &gamma2, unsi
     resize(statePosteriors2, 2, Exact());
     for (unsigned s = 0; s < 2; ++s)
     {
-        resize(statePosteriors1[s], length(this->statePosteriors[s][0]), Exact());
-        resize(statePosteriors2[s], length(this->statePosteriors[s][0]), Exact());
-        for (unsigned i = 0; i < length(this->statePosteriors[s][0]); ++i)
+        resize(statePosteriors1[s], length(this->setObs[s]), Exact());
+        resize(statePosteriors2[s], length(this->setObs[s]), Exact());
+        for (unsigned i = 0; i < length(this->setObs[s]); ++i)
         {
-            resize(statePosteriors1[s][i], length(this->statePosteriors[s][0][i]), Exact());
-            resize(statePosteriors2[s][i], length(this->statePosteriors[s][0][i]), Exact());
-            for (unsigned t = 0; t < length(this->statePosteriors[s][0][i]); ++t)
+            resize(statePosteriors1[s][i], this->setObs[s][i].length(), Exact());
+            resize(statePosteriors2[s][i], this->setObs[s][i].length(), Exact());
+            for (unsigned t = 0; t < this->setObs[s][i].length(); ++t)
             {
-                statePosteriors1[s][i][t] = this->statePosteriors[s][0][i][t] + this->statePosteriors[s][1][i][t];
-                statePosteriors2[s][i][t] = this->statePosteriors[s][2][i][t] + this->statePosteriors[s][3][i][t];
+                statePosteriors1[s][i][t] = statePosterior(this->statePosteriors[s], i, t, 0) + statePosterior(this->statePosteriors[s], i, t, 1);
+                statePosteriors2[s][i][t] = statePosterior(this->statePosteriors[s], i, t, 2) + statePosterior(this->statePosteriors[s], i, t, 3);
             }
         }
     }
@@ -905,16 +1286,16 @@ bool HMM<TGAMMA, TBIN>::updateDensityParams(ModelParams<TGAMMA, TBIN> &modelPara
     resize(statePosteriors2, 2, Exact());
     for (unsigned s = 0; s < 2; ++s)
     {
-        resize(statePosteriors1[s], length(this->statePosteriors[s][0]), Exact());
-        resize(statePosteriors2[s], length(this->statePosteriors[s][0]), Exact());
-        for (unsigned i = 0; i < length(this->statePosteriors[s][0]); ++i)
+        resize(statePosteriors1[s], length(this->setObs[s]), Exact());
+        resize(statePosteriors2[s], length(this->setObs[s]), Exact());
+        for (unsigned i = 0; i < length(this->setObs[s]); ++i)
         {
-            resize(statePosteriors1[s][i], length(this->statePosteriors[s][0][i]), Exact());
-            resize(statePosteriors2[s][i], length(this->statePosteriors[s][0][i]), Exact());
-            for (unsigned t = 0; t < length(this->statePosteriors[s][0][i]); ++t)
+            resize(statePosteriors1[s][i], this->setObs[s][i].length(), Exact());
+            resize(statePosteriors2[s][i], this->setObs[s][i].length(), Exact());
+            for (unsigned t = 0; t < this->setObs[s][i].length(); ++t)
             {
-                statePosteriors1[s][i][t] = this->statePosteriors[s][2][i][t];
-                statePosteriors2[s][i][t] = this->statePosteriors[s][3][i][t];
+                statePosteriors1[s][i][t] = statePosterior(this->statePosteriors[s], i, t, 2);
+                statePosteriors2[s][i][t] = statePosterior(this->statePosteriors[s], i, t, 3);
             }
         }
     }
@@ -945,7 +1326,10 @@ bool HMM<TGAMMA, TBIN>::baumWelch(ModelParams<TGAMMA, TBIN> &modelParams, CharSt
     {
         std::cout << ".. " << iter << "th iteration " << std::endl;
         std::cout << "                        computeEmissionProbs() " << std::endl;
-        if (!computeEmissionProbs(modelParams, true, options) )
+        // only parameters of densities learned in previous iteration changed, log-densities of the others are cached
+        bool updateGamma = (iter == 0 || learnTag != "LEARN_BINOMIAL");
+        bool updateBin = (iter == 0 || learnTag == "LEARN_BINOMIAL");
+        if (!computeEmissionProbs(modelParams, true, updateGamma, updateBin, options) )
         {
             std::cerr << "ERROR: Could not compute emission probabilities! " << std::endl;
             return false;
@@ -1054,9 +1438,9 @@ void HMM<TGAMMA, TBIN>::posteriorDecoding(String<String<String<__uint8> > > &sta
                     unsigned max_k = 0;
                     for (unsigned k = 0; k < this->K; ++k)
                     {
-                        if (this->statePosteriors[s][k][i][t] > max_p)
+                        if (statePosterior(this->statePosteriors[s], i, t, k) > max_p)
                         {
-                            max_p = this->statePosteriors[s][k][i][t];
+                            max_p = statePosterior(this->statePosteriors[s], i, t, k);
                             max_k = k;
                         }
                     }
@@ -1177,11 +1561,17 @@ double getCrosslinkSiteScore(double postProb0, double postProb1, double postProb
     }
 }
 
+inline double getCrosslinkSiteScore(StatePosteriors const &statePosteriors, unsigned i, unsigned t, unsigned score_type)
+{
+    return getCrosslinkSiteScore(statePosterior(statePosteriors, i, t, 0), statePosterior(statePosteriors, i, t, 1), 
+                                 statePosterior(statePosteriors, i, t, 2), statePosterior(statePosteriors, i, t, 3), score_type);
+}
+
 
 
 void writeStates(String<BedRecord<Bed6> > &bedRecords_sites,
                  Data &data,
-                 FragmentStore<> &store, 
+                 ReferenceStore &store, 
                  unsigned contigId,
                  AppOptions &options)          
 { 
@@ -1209,9 +1599,9 @@ void writeStates(String<BedRecord<Bed6> > &bedRecords_sites,
                     else                 // '-'-strand;
                     {
                         if (!options.crosslinkAtTruncSite) 
-                            record.beginPos = length(store.contigStore[contigId].seq) - (t + data.setPos[s][i]);
+                            record.beginPos = contigLength(store, contigId) - (t + data.setPos[s][i]);
                         else
-                            record.beginPos = length(store.contigStore[contigId].seq) - (t + data.setPos[s][i]) - 1;
+                            record.beginPos = contigLength(store, contigId) - (t + data.setPos[s][i]) - 1;
 
                         record.endPos = record.beginPos + 1;
                     }
@@ -1222,7 +1612,7 @@ void writeStates(String<BedRecord<Bed6> > &bedRecords_sites,
                     ss.str("");  
                     ss.clear();  
 
-                    ss << getCrosslinkSiteScore(data.statePosteriors[s][0][i][t], data.statePosteriors[s][1][i][t], data.statePosteriors[s][2][i][t], data.statePosteriors[s][3][i][t], options.score_type);
+                    ss << getCrosslinkSiteScore(data.statePosteriors[s], i, t, options.score_type);
                     record.score = ss.str();
                     ss.str("");  
                     ss.clear();  
@@ -1240,14 +1630,14 @@ void writeStates(String<BedRecord<Bed6> > &bedRecords_sites,
                     ss << (double)data.setObs[s][i].kdes[t];
                     ss << ";";
 
-                    ss << (double)data.statePosteriors[s][3][i][t];
+                    ss << (double)statePosterior(data.statePosteriors[s], i, t, 3);
                     ss << ";"; 
                     if (options.useCov_RPKM)
                         ss << (double)data.setObs[s][i].rpkms[t];
                     else
                         ss << 0.0;
                     ss << ";";
-                    ss << (double)log((data.statePosteriors[s][2][i][t] + data.statePosteriors[s][3][i][t])/(data.statePosteriors[s][0][i][t] + data.statePosteriors[s][1][i][t]));
+                    ss << (double)log((statePosterior(data.statePosteriors[s], i, t, 2) + statePosterior(data.statePosteriors[s], i, t, 3))/(statePosterior(data.statePosteriors[s], i, t, 0) + statePosterior(data.statePosteriors[s], i, t, 1)));
                     ss << ";";
 
                     record.data = ss.str();
@@ -1273,9 +1663,9 @@ void writeStates(String<BedRecord<Bed6> > &bedRecords_sites,
                     else                 // '-'-strand;
                     {
                         if (!options.crosslinkAtTruncSite) 
-                            record.beginPos = length(store.contigStore[contigId].seq) - (t + data.setPos[s][i]);
+                            record.beginPos = contigLength(store, contigId) - (t + data.setPos[s][i]);
                         else
-                            record.beginPos = length(store.contigStore[contigId].seq) - (t + data.setPos[s][i]) - 1;
+                            record.beginPos = contigLength(store, contigId) - (t + data.setPos[s][i]) - 1;
 
                         record.endPos = record.beginPos + 1;
                     }
@@ -1339,9 +1729,9 @@ void writeStates(String<BedRecord<Bed6> > &bedRecords_sites,
                     else
                     {
                         if (!options.crosslinkAtTruncSite)
-                            record.beginPos = length(store.contigStore[contigId].seq) - (t + data.setPos[s][i]);
+                            record.beginPos = contigLength(store, contigId) - (t + data.setPos[s][i]);
                         else
-                            record.beginPos = length(store.contigStore[contigId].seq) - (t + data.setPos[s][i]) - 1;
+                            record.beginPos = contigLength(store, contigId) - (t + data.setPos[s][i]) - 1;
 
                         record.endPos = record.beginPos + 1;
                     }
@@ -1352,7 +1742,7 @@ void writeStates(String<BedRecord<Bed6> > &bedRecords_sites,
                     ss.str("");  
                     ss.clear();  
 
-                    ss << getCrosslinkSiteScore(data.statePosteriors[s][0][i][t], data.statePosteriors[s][1][i][t], data.statePosteriors[s][2][i][t], data.statePosteriors[s][3][i][t], options.score_type);
+                    ss << getCrosslinkSiteScore(data.statePosteriors[s], i, t, options.score_type);
                     record.score = ss.str();
                     ss.str("");  
                     ss.clear();  
@@ -1361,10 +1751,10 @@ void writeStates(String<BedRecord<Bed6> > &bedRecords_sites,
                     else
                         record.strand = '-';
 
-                    ss << "[score_CL=" << getCrosslinkSiteScore(data.statePosteriors[s][0][i][t], data.statePosteriors[s][1][i][t], data.statePosteriors[s][2][i][t], data.statePosteriors[s][3][i][t], 1) << ";";
-                    ss << "score_E=" << getCrosslinkSiteScore(data.statePosteriors[s][0][i][t], data.statePosteriors[s][1][i][t], data.statePosteriors[s][2][i][t], data.statePosteriors[s][3][i][t], 2) << ";";
-                    ss << "score_B=" << getCrosslinkSiteScore(data.statePosteriors[s][0][i][t], data.statePosteriors[s][1][i][t], data.statePosteriors[s][2][i][t], data.statePosteriors[s][3][i][t], 3) << ";";
-                    ss << "score_UC=" << getCrosslinkSiteScore(data.statePosteriors[s][0][i][t], data.statePosteriors[s][1][i][t], data.statePosteriors[s][2][i][t], data.statePosteriors[s][3][i][t], 0) << "]";
+                    ss << "[score_CL=" << getCrosslinkSiteScore(data.statePosteriors[s], i, t, 1) << ";";
+                    ss << "score_E=" << getCrosslinkSiteScore(data.statePosteriors[s], i, t, 2) << ";";
+                    ss << "score_B=" << getCrosslinkSiteScore(data.statePosteriors[s], i, t, 3) << ";";
+                    ss << "score_UC=" << getCrosslinkSiteScore(data.statePosteriors[s], i, t, 0) << "]";
 
                     record.data = ss.str();
                     ss.str("");  
@@ -1380,7 +1770,7 @@ void writeStates(String<BedRecord<Bed6> > &bedRecords_sites,
 
 void writeRegions(String<BedRecord<Bed6> > &bedRecords_regions,
                  Data &data,
-                 FragmentStore<> &store, 
+                 ReferenceStore &store, 
                  unsigned contigId,
                  AppOptions &options)          
 { 
@@ -1406,9 +1796,9 @@ void writeRegions(String<BedRecord<Bed6> > &bedRecords_regions,
                     else
                     {
 		                if (!options.crosslinkAtTruncSite)
-                            record.beginPos = length(store.contigStore[contigId].seq) - (t + data.setPos[s][i]);
+                            record.beginPos = contigLength(store, contigId) - (t + data.setPos[s][i]);
                         else
-                            record.beginPos = length(store.contigStore[contigId].seq) - (t + data.setPos[s][i]) - 1;
+                            record.beginPos = contigLength(store, contigId) - (t + data.setPos[s][i]) - 1;
 
                         record.endPos = record.beginPos + 1;
                     }
@@ -1419,7 +1809,7 @@ void writeRegions(String<BedRecord<Bed6> > &bedRecords_regions,
                         record.strand = '-';
 
                     unsigned prev_cs = t;
-                    double score = getCrosslinkSiteScore(data.statePosteriors[s][0][i][t], data.statePosteriors[s][1][i][t], data.statePosteriors[s][2][i][t], data.statePosteriors[s][3][i][t], options.score_type);
+                    double score = getCrosslinkSiteScore(data.statePosteriors[s], i, t, options.score_type);
                     double scoresSum = score;
                     std::stringstream ss_indivScores;
                     ss_indivScores << score << ';';
@@ -1438,12 +1828,12 @@ void writeRegions(String<BedRecord<Bed6> > &bedRecords_regions,
                             else
                             {
                                 if (!options.crosslinkAtTruncSite)                                
-                                    record.beginPos = length(store.contigStore[contigId].seq) - (t + data.setPos[s][i]);
+                                    record.beginPos = contigLength(store, contigId) - (t + data.setPos[s][i]);
                                 else
-                                    record.beginPos = length(store.contigStore[contigId].seq) - (t + data.setPos[s][i]) - 1;
+                                    record.beginPos = contigLength(store, contigId) - (t + data.setPos[s][i]) - 1;
                             }                
 
-                            score = getCrosslinkSiteScore(data.statePosteriors[s][0][i][t], data.statePosteriors[s][1][i][t], data.statePosteriors[s][2][i][t], data.statePosteriors[s][3][i][t], options.score_type);
+                            score = getCrosslinkSiteScore(data.statePosteriors[s], i, t, options.score_type);
                             scoresSum += score;
                             ss_indivScores << score << ';';
                             prev_cs = t;
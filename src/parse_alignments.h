@@ -26,66 +26,186 @@
 
 #include <iostream>
 #include <fstream>
+#include <queue>
+#include <vector>
 
 using namespace seqan;
 
 
+// truncation sites of reverse strand reads, not yet added to (sorted) observations
+typedef std::priority_queue<unsigned, std::vector<unsigned>, std::greater<unsigned> > TTruncPosQueue;
 
+
+// add pending reverse strand truncation sites < pos (no further alignment can end before its begin position)
+template <typename TContigObservations, typename TOptions>
+inline void flushReadStarts(TContigObservations &contigObservationsR, TTruncPosQueue &pendingR, unsigned pos, TOptions &options)
+{
+    while (!pendingR.empty() && pendingR.top() < pos)
+    {
+        appendTruncCount(contigObservationsR, pendingR.top(), 1, options.maxTruncCount2);
+        pendingR.pop();
+    }
+}
+
+
+// add read start (truncation site) of alignment to forward or reverse strand counts
+// NOTE: alignments have to be sorted by begin position, reverse strand truncation sites are kept in pendingR until all smaller positions are known,
+//       truncation sites of reverse strand reads outside of [beginPos, endPos) are collected in outsideR
+template <typename TContigObservations, typename TOptions>
+inline void addReadStart(TContigObservations &contigObservationsF, TContigObservations &contigObservationsR, TTruncPosQueue &pendingR, String<unsigned> &outsideR, 
+                         BamAlignmentRecord const &bamRecord, unsigned beginPos, unsigned endPos, TOptions &options)
+{
+    // check if read corresponds to 3' cDNA end corresponding to user parameter
+    if (options.selectRead == 1 && !hasFlagFirst(bamRecord))
+        return;
+    else if (options.selectRead == 2 && !hasFlagLast(bamRecord))
+        return;
+
+    if (!hasFlagRC(bamRecord))          // Forward
+    {
+        appendTruncCount(contigObservationsF, bamRecord.beginPos, 1, options.maxTruncCount2);
+    }
+    else                                // Reverse  
+    {
+        flushReadStarts(contigObservationsR, pendingR, bamRecord.beginPos, options);
+        unsigned truncPos = bamRecord.beginPos + getAlignmentLengthInRef(bamRecord) - 1;
+        if (truncPos < beginPos || truncPos >= endPos)
+            appendValue(outsideR, truncPos, Generous());
+        else
+            pendingR.push(truncPos);
+    }
+}
+
+
+// Parse read start counts within region [beginPos, endPos) of contig rID
+// NOTE: reads are assigned to the region containing their begin position (allows to decode regions of one contig in parallel), 
+//       truncation sites of reverse strand reads ending outside of this region are collected in outsideR and have to be added afterwards
 template <typename TContigObservations, typename TBamIn, typename TBai, typename TOptions>
-bool parse_bamRegion(TContigObservations &contigObservationsF, TContigObservations &contigObservationsR,  TBamIn &inFile, TBai &baiIndex, int const& rID, TOptions &options)
+bool parse_bamRegion(TContigObservations &contigObservationsF, TContigObservations &contigObservationsR, String<unsigned> &outsideR, bool &hasAlignments, 
+                     TBamIn &inFile, TBai &baiIndex, int const& rID, unsigned beginPos, unsigned endPos, TOptions &options)
 {
     if (options.verbosity >= 2)
-        std::cout << "Parse BAM region " << std::endl;
+        std::cout << "Parse BAM region " << beginPos << ":" << endPos << std::endl;
  
-    int jump_beginPos = 0;
     // Jump the BGZF stream to this position.
-    bool hasAlignments = false;
-    if (!jumpToRegion(inFile, hasAlignments, rID, jump_beginPos, length(contigObservationsF.truncCounts)-1, baiIndex))
+    hasAlignments = false;
+    if (!jumpToRegion(inFile, hasAlignments, rID, beginPos, endPos, baiIndex))
     {
-        std::cerr << "ERROR: Could not jump to " << jump_beginPos << ":" << (length(contigObservationsF.truncCounts)-1) << "\n";
+        std::cerr << "ERROR: Could not jump to " << beginPos << ":" << endPos << "\n";
         return false;
     }
     if (!hasAlignments)
     {
         if (options.verbosity >= 2)
-            std::cout << "WARNING: no alignments here " << jump_beginPos << ":" << (length(contigObservationsF.truncCounts)-1) << "\n";
-        return false;  
+            std::cout << "WARNING: no alignments here " << beginPos << ":" << endPos << "\n";
+        return true;  
     }
 
     // Seek linearly to the selected position
     BamAlignmentRecord bamRecord;
-    BamAlignmentRecord newBamRecord;
+    TTruncPosQueue pendingR;
 
-    SEQAN_OMP_PRAGMA(critical)
+    // NOTE: no critical section needed, each thread reads from its own BamFileIn (and BGZF stream), BAI index is only read
     while (!atEnd(inFile))
     {
         readRecord(bamRecord, inFile);
 
-        // If we are on the next reference 
+        // If we are on the next reference or region
         if (bamRecord.rID == -1 || bamRecord.rID > rID)
             break;
-
-        // check if read corresponds to 3' cDNA end corresponding to user parameter
-        if (options.selectRead == 1 && !hasFlagFirst(bamRecord))
-            continue;
-        else if (options.selectRead == 2 && !hasFlagLast(bamRecord))
+        if (bamRecord.beginPos >= (int)endPos)
+            break;
+        if (bamRecord.beginPos < (int)beginPos)     // parsed within previous region
             continue;
 
-        if (!hasFlagRC(bamRecord))          // Forward
-        {
-            if (contigObservationsF.truncCounts[bamRecord.beginPos] < options.maxTruncCount2)      // uint8, discard interval if > anyway ...
-                ++contigObservationsF.truncCounts[bamRecord.beginPos]; 
-        }
-        else                                // Reverse  
-        {
-            if (contigObservationsR.truncCounts[bamRecord.beginPos + getAlignmentLengthInRef(bamRecord) - 1] < options.maxTruncCount2)
-                ++contigObservationsR.truncCounts[bamRecord.beginPos + getAlignmentLengthInRef(bamRecord) - 1]; 
-        }
+        addReadStart(contigObservationsF, contigObservationsR, pendingR, outsideR, bamRecord, beginPos, endPos, options);
     }
+    flushReadStarts(contigObservationsR, pendingR, endPos, options);
     return true;
 }
 
 
+// Sequential reader for coordinate sorted BAM files: contigs are parsed one after another from start to end, without jumping via the BAI index
+struct BamStream
+{
+    BamFileIn           inFile;
+    BamAlignmentRecord  bamRecord;      // next record, not parsed yet
+    bool                hasRecord;
+    bool                unsorted;       // records found not to be sorted by coordinate
+
+    BamStream() : hasRecord(false), unsorted(false) {}
+};
+
+
+bool openBamStream(BamStream &bamStream, CharString const &bamFileName)
+{
+    if (!open(bamStream.inFile, toCString(bamFileName)))
+    {
+        std::cerr << "ERROR: Could not open " << bamFileName << " for reading.\n";
+        return false;
+    }
+    BamHeader header;
+    readHeader(header, bamStream.inFile);
+
+    bamStream.hasRecord = !atEnd(bamStream.inFile);
+    if (bamStream.hasRecord)
+        readRecord(bamStream.bamRecord, bamStream.inFile);
+    return true;
+}
+
+
+// read next record of BAM stream, stops if BAM file is not sorted by coordinate (unmapped reads without position at the end)
+bool readNextRecord(BamStream &bamStream)
+{
+    int prevRID = bamStream.bamRecord.rID;
+    int prevBeginPos = bamStream.bamRecord.beginPos;
+    bamStream.hasRecord = !atEnd(bamStream.inFile);
+    if (!bamStream.hasRecord)
+        return true;
+    readRecord(bamStream.bamRecord, bamStream.inFile);
+
+    int rID = bamStream.bamRecord.rID;
+    if (rID != -1 && (prevRID == -1 || rID < prevRID || (rID == prevRID && bamStream.bamRecord.beginPos < prevBeginPos)))
+    {
+        std::cerr << "ERROR: BAM file is not sorted by coordinate (record " << bamStream.bamRecord.qName << "), please sort it first.\n";
+        bamStream.hasRecord = false;
+        bamStream.unsorted = true;
+        return false;
+    }
+    return true;
+}
+
+
+// Parse read start counts of contig rID from BAM stream, alignments of preceding contigs are skipped
+// NOTE: contigs have to be requested in the same order as in the BAM file
+//       returns false if no alignments or BAM file not sorted by coordinate (bamStream.unsorted set)
+template <typename TContigObservations, typename TOptions>
+bool parse_bamContig(TContigObservations &contigObservationsF, TContigObservations &contigObservationsR, String<unsigned> &outsideR, 
+                     BamStream &bamStream, int const& rID, TOptions &options)
+{
+    if (options.verbosity >= 2)
+        std::cout << "Parse BAM contig " << rID << " from stream" << std::endl;
+
+    bool hasAlignments = false;
+    TTruncPosQueue pendingR;
+    while (bamStream.hasRecord)
+    {
+        // If we are on the next reference, keep record for next contig 
+        if (bamStream.bamRecord.rID == -1 || bamStream.bamRecord.rID > rID)
+            break;
+
+        if (bamStream.bamRecord.rID == rID)
+        {
+            hasAlignments = true;
+            addReadStart(contigObservationsF, contigObservationsR, pendingR, outsideR, bamStream.bamRecord, 0, contigObservationsR.contigLength, options);
+        }
+
+        if (!readNextRecord(bamStream))
+            return false;
+    }
+    flushReadStarts(contigObservationsR, pendingR, contigObservationsR.contigLength, options);
+    return hasAlignments;
+}
 
 
 template <typename TTruncCounts, typename TBamIn, typename TBai, typename TOptions>
@@ -114,7 +234,7 @@ bool parse_bamRegion(TTruncCounts &truncCounts, TBamIn &inFile, TBai &baiIndex,
     BamAlignmentRecord bamRecord;
     BamAlignmentRecord newBamRecord;
 
-    SEQAN_OMP_PRAGMA(critical)
+    // NOTE: no critical section needed, each thread reads from its own BamFileIn (and BGZF stream), BAI index is only read
     while (!atEnd(inFile))
     {
         readRecord(bamRecord, inFile);
@@ -306,6 +306,11 @@ void estimateTransitions(String<String<long double> > &initTrans,
                          Data &data,
                          AppOptions &options)
 {
+    updateDensityTables(bin1);
+    updateDensityTables(bin2);
+    updateNormalizers(gamma1);
+    updateNormalizers(gamma2);
+
     // split into non-enriched and enriched
     String<String<unsigned> >  transFreqs;
     resize(transFreqs, 4, Exact());
@@ -445,6 +450,9 @@ void estimateTransitions(String<String<long double> > &initTrans,
                          Data &data,
                          AppOptions &options)
 {
+    updateDensityTables(bin1);
+    updateDensityTables(bin2);
+
     // split into non-enriched and enriched
     String<String<unsigned> >  transFreqs;
     resize(transFreqs, 4, Exact());
@@ -57,16 +57,17 @@ parseCommandLine(AppOptions & options, int argc, char const ** argv)
 
     // Define usage line and long description.
     addUsageLine(parser, "[\\fIOPTIONS\\fP] <-i \\fIBAM FILE\\fP> <-bai \\fIBAI FILE\\fP> <-g \\fIGENOME FILE\\fP> <-o \\fIOUTPUT BED FILE\\fP> ");
+    addUsageLine(parser, "[\\fIOPTIONS\\fP] <-i \\fIPCTC FILE\\fP> <-g \\fIGENOME FILE\\fP> <-o \\fIOUTPUT BED FILE\\fP> ");
+    addUsageLine(parser, "index [\\fIOPTIONS\\fP] <-i \\fIBAM FILE\\fP> <-o \\fIPCTC FILE\\fP> ");
     addDescription(parser, "Protein-RNA interaction site detection using a non-homogeneous HMM.");
 
     // rep1 [rep2]
-    addOption(parser, ArgParseOption("i", "in", "Target bam files.", ArgParseArgument::INPUT_FILE, "BAM", true));
-    setValidValues(parser, "in", ".bam");
+    addOption(parser, ArgParseOption("i", "in", "Target bam files or read start count index files (.pctc, see 'pureclip index').", ArgParseArgument::INPUT_FILE, "BAM", true));
+    setValidValues(parser, "in", ".bam .pctc");
     setRequired(parser, "in", true);
 
-    addOption(parser, ArgParseOption("bai", "bai", "Target bam index files.", ArgParseArgument::INPUT_FILE, "BAI", true));
+    addOption(parser, ArgParseOption("bai", "bai", "Target bam index files. Not required for read start count index files.", ArgParseArgument::INPUT_FILE, "BAI", true));
     setValidValues(parser, "bai", ".bai");
-    setRequired(parser, "bai", true);
 
     addOption(parser, ArgParseOption("g", "genome", "Genome reference file.", ArgParseArgument::INPUT_FILE));
     setValidValues(parser, "genome", ".fa .fasta .fa.gz .fasta.gz");
@@ -111,12 +112,19 @@ parseCommandLine(AppOptions & options, int argc, char const ** argv)
     addOption(parser, ArgParseOption("dm", "dm", "Distance used to merge individual crosslink sites to binding regions. Default: 8", ArgParseArgument::INTEGER));
 
     addOption(parser, ArgParseOption("ld", "ld", "Use higher precision to store emission probabilities, state poster posterior probabilities etc. (i.e. long double). Should not be necessary anymore, due to computations in log-space. Note: increases memory consumption. Default: double."));
-    addOption(parser, ArgParseOption("ts", "ts", "Size of look-up table for log-sum-exp values. Default: 600000", ArgParseArgument::INTEGER));
-    addOption(parser, ArgParseOption("tmv", "tmv", "Minimum value in look-up table for log-sum-exp values. Default: -2000", ArgParseArgument::DOUBLE));
+    addOption(parser, ArgParseOption("sfb", "sfb", "Use scaled probabilities (with normalization factors per position) instead of log-space for forward-backward computations."));
+    hideOption(parser, "sfb");
+    addOption(parser, ArgParseOption("vfb", "vfb", "Validate forward-backward computations against log-space and long double and report the max. deviation of state posterior probabilities."));
+    hideOption(parser, "vfb");
+    addOption(parser, ArgParseOption("ts", "ts", "Size of previous look-up table for log-sum-exp values, only used as reference in 'pureclip benchmark-lse'. Default: 600000", ArgParseArgument::INTEGER));
+    hideOption(parser, "ts");
+    addOption(parser, ArgParseOption("tmv", "tmv", "Minimum value in previous look-up table for log-sum-exp values, only used as reference in 'pureclip benchmark-lse'. Default: -2000", ArgParseArgument::DOUBLE));
+    hideOption(parser, "tmv");
 
     addOption(parser, ArgParseOption("ur", "ur", "Flag to define which read should be selected for the analysis: 1->R1, 2->R2. Note: PureCLIP uses read starts corresponding to 3' cDNA ends. Thus if providing paired-end data, only the corresponding read should be selected (e.g. eCLIP->R2, iCLIP->R1). If applicable, used for input BAM file as well. Default: uses read starts of all provided reads assuming single-end or pre-filtered data.", ArgParseArgument::INTEGER));
     setMinValue(parser, "ur", "1");
     setMaxValue(parser, "ur", "2");
+    addOption(parser, ArgParseOption("sb", "sb", "Parse target BAM files once from start to end instead of jumping to each contig using the BAI index. Recommended for transcript-wise alignments with many contigs. Requires contigs (-iv, -chr) to be in the same order as in BAM file."));
 
     addSection(parser, "Options for incorporating covariates");
 
@@ -182,6 +190,7 @@ parseCommandLine(AppOptions & options, int argc, char const ** argv)
     addSection(parser, "General user options");
     addOption(parser, ArgParseOption("nt", "nt", "Number of threads used for learning.", ArgParseArgument::INTEGER));
     addOption(parser, ArgParseOption("nta", "nta", "Number of threads used for applying learned parameters. Increases memory usage, if greater than number of chromosomes used for learning, since HMM will be build for multiple chromosomes in parallel. Default: min(nt, no. of chromosomes/transcripts used for learning).", ArgParseArgument::INTEGER));
+    addOption(parser, ArgParseOption("tcm", "tcm", "Memory (in MB) used to keep read start counts of contigs used for learning, which are reused when applying learned parameters. Counts exceeding this limit are written to temporary files next to the output file. Default: 0 (no limit).", ArgParseArgument::INTEGER));
     addOption(parser, ArgParseOption("oa", "oa", "Outputs all sites with at least one read start in extended output format."));
     addOption(parser, ArgParseOption("oe", "oe", "Outputs additionally all sites that are 'enriched' and contain at least one read start."));
     hideOption(parser, "oe");
@@ -220,23 +229,30 @@ parseCommandLine(AppOptions & options, int argc, char const ** argv)
         return res;
 
     unsigned repNo = getOptionValueCount(parser, "in");
-    if (repNo != getOptionValueCount(parser, "bai"))
+    resize(options.bamFileNames, repNo);
+    unsigned indexNo = 0;
+    for (unsigned i = 0; i < repNo; ++i)
     {
-        std::cout << "ERROR: currently only support for <= 2 replicates!" << std::endl;
+        getOptionValue(options.bamFileNames[i], parser, "in", i);
+        std::string fileName = toCString(options.bamFileNames[i]);
+        if (fileName.size() > 5 && fileName.compare(fileName.size() - 5, 5, ".pctc") == 0)
+            ++indexNo;
+    }
+    if (indexNo > 0 && indexNo != repNo)
+    {
+        std::cout << "ERROR: either BAM files or read start count index files (.pctc) must be given as target files!" << std::endl;
         return ArgumentParser::PARSE_ERROR;
     }
-    if (repNo != getOptionValueCount(parser, "bai"))
+    options.useTruncCountIndex = (indexNo > 0);
+    if (!options.useTruncCountIndex && repNo != getOptionValueCount(parser, "bai"))
     {
         std::cout << "ERROR: number of BAI files must be the same as of BAM files!" << std::endl;
         return ArgumentParser::PARSE_ERROR;
     }
-    resize(options.bamFileNames, repNo);
+    // NOTE: baiFileNames also define the number of replicates
     resize(options.baiFileNames, repNo);
-    for (unsigned i = 0; i < repNo; ++i)
-    {
-        getOptionValue(options.bamFileNames[i], parser, "in", i);
+    for (unsigned i = 0; i < repNo && !options.useTruncCountIndex; ++i)
         getOptionValue(options.baiFileNames[i], parser, "bai", i);
-    }
 
     getOptionValue(options.refFileName, parser, "genome");
     getOptionValue(options.outFileName, parser, "out");
@@ -305,9 +321,16 @@ parseCommandLine(AppOptions & options, int argc, char const ** argv)
     getOptionValue(options.distMerge, parser, "dm");
     if (isSet(parser, "ld"))
         options.useHighPrecision = true;
-    getOptionValue(options.lookupTable_size, parser, "ts");
-    getOptionValue(options.lookupTable_minValue, parser, "tmv");
+    if (isSet(parser, "sfb"))
+        options.scaledFB = true;
+    if (isSet(parser, "vfb"))
+        options.validateFB = true;
+    // log-sum-exp look-up table of forward-backward is fixed, -ts/-tmv only used by 'pureclip benchmark-lse'
+    if (isSet(parser, "ts") || isSet(parser, "tmv"))
+        std::cerr << "WARNING: Options -ts and -tmv are ignored, they are only used by 'pureclip benchmark-lse'.\n";
     getOptionValue(options.selectRead, parser, "ur");
+    if (isSet(parser, "sb") && !options.useTruncCountIndex)
+        options.streamBam = true;
 
     getOptionValue(options.polyAThreshold, parser, "pat");
     if (isSet(parser, "epal"))
@@ -332,6 +355,7 @@ parseCommandLine(AppOptions & options, int argc, char const ** argv)
 
     getOptionValue(options.numThreads, parser, "nt");
     getOptionValue(options.numThreadsA, parser, "nta");
+    getOptionValue(options.cacheMemory, parser, "tcm");
 
     if (isSet(parser, "oa"))
         options.outputAll = true;
@@ -353,14 +377,85 @@ parseCommandLine(AppOptions & options, int argc, char const ** argv)
 }
 
 
+// 'pureclip index': write read start count index of BAM file
+ArgumentParser::ParseResult
+parseIndexCommandLine(AppOptions & options, int argc, char const ** argv)
+{
+    ArgumentParser parser("pureclip index");
+    setShortDescription(parser, "Build read start count index");
+    setVersion(parser, "1.3.1");
+    setDate(parser, "April 2019");
+
+    addUsageLine(parser, "[\\fIOPTIONS\\fP] <-i \\fIBAM FILE\\fP> <-o \\fIPCTC FILE\\fP> ");
+    addDescription(parser, "Parses the read starts of a coordinate sorted BAM file once and writes them to a read start count index file (.pctc). The index can be given with -i instead of the BAM and BAI file to avoid parsing the BAM file again, e.g. when running PureCLIP repeatedly with different parameter settings.");
+
+    addOption(parser, ArgParseOption("i", "in", "Target bam file.", ArgParseArgument::INPUT_FILE));
+    setValidValues(parser, "in", ".bam");
+    setRequired(parser, "in", true);
+
+    addOption(parser, ArgParseOption("o", "out", "Output read start count index file.", ArgParseArgument::OUTPUT_FILE));
+    setValidValues(parser, "out", ".pctc");
+    setRequired(parser, "out", true);
+
+    addOption(parser, ArgParseOption("ur", "ur", "Flag to define which read should be selected: 1->R1, 2->R2. Must be the same as used for PureCLIP later. Default: uses read starts of all provided reads.", ArgParseArgument::INTEGER));
+    setMinValue(parser, "ur", "1");
+    setMaxValue(parser, "ur", "2");
+
+    addOption(parser, ArgParseOption("q", "quiet", "Set verbosity to a minimum."));
+    addOption(parser, ArgParseOption("v", "verbose", "Enable verbose output."));
+
+    // skip subcommand
+    ArgumentParser::ParseResult res = parse(parser, argc - 1, argv + 1);
+    if (res != ArgumentParser::PARSE_OK)
+        return res;
+
+    resize(options.bamFileNames, 1);
+    getOptionValue(options.bamFileNames[0], parser, "in");
+    getOptionValue(options.outFileName, parser, "out");
+    getOptionValue(options.selectRead, parser, "ur");
+    if (isSet(parser, "quiet"))
+        options.verbosity = 0;
+    if (isSet(parser, "verbose"))
+        options.verbosity = 2;
+
+    return ArgumentParser::PARSE_OK;
+}
+
+
+ArgumentParser::ParseResult
+parseBenchmarkCommandLine(AppOptions & options, unsigned &n, int argc, char const ** argv)
+{
+    ArgumentParser parser("pureclip benchmark-lse");
+    setShortDescription(parser, "Benchmark log-sum-exp computations");
+    setVersion(parser, "1.3.1");
+    setDate(parser, "April 2019");
+
+    addUsageLine(parser, "[\\fIOPTIONS\\fP]");
+    addDescription(parser, "Compares throughput and accuracy of the interpolated log-sum-exp table used for forward-backward computations with the previous look-up table.");
+
+    addOption(parser, ArgParseOption("n", "n", "Number of log-sum-exp computations over 4 states. Default: 10000000", ArgParseArgument::INTEGER));
+    setMinValue(parser, "n", "1");
+    addOption(parser, ArgParseOption("ts", "ts", "Size of previous look-up table for log-sum-exp values. Default: 600000", ArgParseArgument::INTEGER));
+    addOption(parser, ArgParseOption("tmv", "tmv", "Minimum value in previous look-up table for log-sum-exp values. Default: -2000", ArgParseArgument::DOUBLE));
+
+    // skip subcommand
+    ArgumentParser::ParseResult res = parse(parser, argc - 1, argv + 1);
+    if (res != ArgumentParser::PARSE_OK)
+        return res;
+
+    getOptionValue(n, parser, "n");
+    getOptionValue(options.lookupTable_size, parser, "ts");
+    getOptionValue(options.lookupTable_minValue, parser, "tmv");
+
+    return ArgumentParser::PARSE_OK;
+}
+
+
 template <typename TOptions>
 bool doIt(TOptions &options)
 {
     unsigned repNo = length(options.baiFileNames);
     
-    LogSumExp_lookupTable lookUp(options.lookupTable_size, options.lookupTable_minValue);
-    options.lookUp = lookUp;
-
     if (options.useCov_RPKM)
     {
 
@@ -434,6 +529,27 @@ int main(int argc, char const ** argv)
     // Parse the command line.
     ArgumentParser parser;
     AppOptions options;
+
+    if (argc > 1 && std::string(argv[1]) == "index")
+    {
+        ArgumentParser::ParseResult res = parseIndexCommandLine(options, argc, argv);
+        if (res != ArgumentParser::PARSE_OK)
+            return res == ArgumentParser::PARSE_ERROR;
+
+        if (options.verbosity >= 1) std::cout << "Build read start count index " << options.outFileName << " ..." << std::endl;
+        return !buildTruncCountIndex(options.bamFileNames[0], options.outFileName, options);
+    }
+    if (argc > 1 && std::string(argv[1]) == "benchmark-lse")
+    {
+        unsigned n = 10000000;
+        ArgumentParser::ParseResult res = parseBenchmarkCommandLine(options, n, argc, argv);
+        if (res != ArgumentParser::PARSE_OK)
+            return res == ArgumentParser::PARSE_ERROR;
+
+        benchmarkLogSumExp(n, options);
+        return 0;
+    }
+
     ArgumentParser::ParseResult res = parseCommandLine(options, argc, argv);
 
     // If there was an error parsing or built-in argument parser functionality
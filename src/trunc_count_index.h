@@ -0,0 +1,241 @@
+// ======================================================================
+// PureCLIP: capturing target-specific protein-RNA interaction footprints
+// ======================================================================
+// Copyright (C) 2017  Sabrina Krakau, Max Planck Institute for Molecular
+// Genetics
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// =======================================================================
+// Author: Sabrina Krakau <krakau@molgen.mpg.de>
+// =======================================================================
+
+#ifndef APPS_HMMS_TRUNC_COUNT_INDEX_H_
+#define APPS_HMMS_TRUNC_COUNT_INDEX_H_
+
+#include <iostream>
+#include <fstream>
+#include <map>
+#include <cstring>
+#include <cstdio>
+
+#include "parse_alignments.h"
+
+using namespace seqan;
+
+
+// Read start count index (.pctc): read start counts of a BAM file, parsed once, stored per contig and strand
+//
+// Layout (host byte order, fixed-width fields):
+//      header:     "PCTC", __uint32 version, __uint32 byte order mark, __uint32 selectRead (-ur), __uint32 no. of contigs, __uint64 offset of directory
+//      data:       per contig and strand one block written by writeTruncCounts() (forward strand coordinates, counts up to 65535)
+//      directory:  per contig __uint32 name length, name, __uint32 contig length, __uint64 block offset forward strand, __uint64 block offset reverse strand
+// NOTE: blocks are addressed by offsets only, i.e. the file can be memory-mapped or read block-wise by several threads
+//       index can only be read on hosts with the same byte order as the one it was built on (checked via byte order mark)
+static const char TRUNC_COUNT_INDEX_MAGIC[4] = {'P', 'C', 'T', 'C'};
+static const __uint32 TRUNC_COUNT_INDEX_VERSION = 2;
+static const __uint32 TRUNC_COUNT_INDEX_BOM = 0x01020304;
+static const __uint32 TRUNC_COUNT_INDEX_BOM_SWAPPED = 0x04030201;
+
+struct TruncCountIndex
+{
+    CharString                      fileName;
+    unsigned                        selectRead;
+    std::map<std::string, unsigned> contigIds;
+    String<__uint32>                contigLengths;
+    String<__uint64>                offsetsF;
+    String<__uint64>                offsetsR;
+};
+
+
+// read header and directory of index
+bool openTruncCountIndex(TruncCountIndex &index, CharString const &fileName)
+{
+    std::ifstream in(toCString(fileName), std::ios::binary);
+    if (!in.good())
+    {
+        std::cerr << "ERROR: Could not open " << fileName << " for reading.\n";
+        return false;
+    }
+    char magic[4];
+    __uint32 version = 0;
+    __uint32 bom = 0;
+    __uint32 selectRead = 0;
+    __uint32 contigNo = 0;
+    __uint64 dirOffset = 0;
+    in.read(magic, 4);
+    in.read(reinterpret_cast<char *>(&version), sizeof(version));
+    in.read(reinterpret_cast<char *>(&bom), sizeof(bom));
+    in.read(reinterpret_cast<char *>(&selectRead), sizeof(selectRead));
+    in.read(reinterpret_cast<char *>(&contigNo), sizeof(contigNo));
+    in.read(reinterpret_cast<char *>(&dirOffset), sizeof(dirOffset));
+    if (!in.good() || std::memcmp(magic, TRUNC_COUNT_INDEX_MAGIC, 4) != 0)
+    {
+        std::cerr << "ERROR: " << fileName << " is not a read start count index file.\n";
+        return false;
+    }
+    if (bom == TRUNC_COUNT_INDEX_BOM_SWAPPED)
+    {
+        std::cerr << "ERROR: Read start count index " << fileName << " was built on a host with different byte order, please rebuild it.\n";
+        return false;
+    }
+    if (version != TRUNC_COUNT_INDEX_VERSION || bom != TRUNC_COUNT_INDEX_BOM)
+    {
+        std::cerr << "ERROR: Version " << version << " of read start count index " << fileName << " not supported, please rebuild it.\n";
+        return false;
+    }
+
+    index.fileName = fileName;
+    index.selectRead = selectRead;
+    index.contigIds.clear();
+    resize(index.contigLengths, contigNo, Exact());
+    resize(index.offsetsF, contigNo, Exact());
+    resize(index.offsetsR, contigNo, Exact());
+
+    in.seekg(dirOffset);
+    for (unsigned i = 0; i < contigNo; ++i)
+    {
+        __uint32 nameLength = 0;
+        in.read(reinterpret_cast<char *>(&nameLength), sizeof(nameLength));
+        std::string name(nameLength, ' ');
+        if (nameLength > 0)
+            in.read(&name[0], nameLength);
+        in.read(reinterpret_cast<char *>(&index.contigLengths[i]), sizeof(__uint32));
+        in.read(reinterpret_cast<char *>(&index.offsetsF[i]), sizeof(__uint64));
+        in.read(reinterpret_cast<char *>(&index.offsetsR[i]), sizeof(__uint64));
+        if (!in.good())
+        {
+            std::cerr << "ERROR: Could not read directory of read start count index " << fileName << ".\n";
+            return false;
+        }
+        index.contigIds[name] = i;
+    }
+    return true;
+}
+
+
+// load read start counts of contig from index (forward strand coordinates for both strands)
+// returns 0 if loaded, 1 if error, 2 if contig not existing in index
+template <typename TContigObservations, typename TOptions>
+int readTruncCounts(TContigObservations &contigObservationsF, TContigObservations &contigObservationsR, TruncCountIndex const &index, CharString const &contigName, unsigned contigLen, TOptions &options)
+{
+    std::map<std::string, unsigned>::const_iterator it = index.contigIds.find(toCString(contigName));
+    if (it == index.contigIds.end())
+        return 2;
+    if (index.contigLengths[it->second] != contigLen)
+    {
+        std::cerr << "ERROR: Length of contig " << contigName << " in read start count index " << index.fileName << " (" << index.contigLengths[it->second] << ") differs from reference (" << contigLen << ").\n";
+        return 1;
+    }
+
+    // each call uses its own stream, i.e. contigs can be loaded in parallel
+    std::ifstream in(toCString(index.fileName), std::ios::binary);
+    in.seekg(index.offsetsF[it->second]);
+    bool ok = readTruncCounts(contigObservationsF, in, contigLen, options.maxTruncCount2);
+    in.seekg(index.offsetsR[it->second]);
+    ok = ok && readTruncCounts(contigObservationsR, in, contigLen, options.maxTruncCount2);
+    if (!ok)
+    {
+        std::cerr << "ERROR: Could not read counts of contig " << contigName << " from read start count index " << index.fileName << ".\n";
+        return 1;
+    }
+    return 0;
+}
+
+
+// Parse BAM file once from start to end and write read start counts of all contigs to index
+template <typename TOptions>
+bool buildTruncCountIndex(CharString const &bamFileName, CharString const &indexFileName, TOptions const &options)
+{
+    BamStream bamStream;
+    if (!openBamStream(bamStream, bamFileName))
+        return false;
+
+    std::ofstream out(toCString(indexFileName), std::ios::binary);
+    if (!out.good())
+    {
+        std::cerr << "ERROR: Could not open " << indexFileName << " for writing.\n";
+        return false;
+    }
+
+    // store full counts, truncated to -mtc2 when loaded
+    TOptions indexOptions = options;
+    indexOptions.maxTruncCount2 = 65535;
+
+    unsigned contigNo = length(contigNames(context(bamStream.inFile)));
+    __uint32 version = TRUNC_COUNT_INDEX_VERSION;
+    __uint32 bom = TRUNC_COUNT_INDEX_BOM;
+    __uint32 selectRead = options.selectRead;
+    __uint32 contigNo32 = contigNo;
+    __uint64 dirOffset = 0;
+    out.write(TRUNC_COUNT_INDEX_MAGIC, 4);
+    out.write(reinterpret_cast<char const *>(&version), sizeof(version));
+    out.write(reinterpret_cast<char const *>(&bom), sizeof(bom));
+    out.write(reinterpret_cast<char const *>(&selectRead), sizeof(selectRead));
+    out.write(reinterpret_cast<char const *>(&contigNo32), sizeof(contigNo32));
+    out.write(reinterpret_cast<char const *>(&dirOffset), sizeof(dirOffset));     // placeholder, set after data is written
+
+    String<__uint64> offsetsF;
+    String<__uint64> offsetsR;
+    resize(offsetsF, contigNo, Exact());
+    resize(offsetsR, contigNo, Exact());
+    for (unsigned rID = 0; rID < contigNo; ++rID)
+    {
+        if (options.verbosity >= 2) std::cout << "Index contig " << contigNames(context(bamStream.inFile))[rID] << std::endl;
+
+        ContigObservations contigObservationsF;
+        ContigObservations contigObservationsR;
+        unsigned contigLen = contigLengths(context(bamStream.inFile))[rID];
+        init(contigObservationsF, contigLen);
+        init(contigObservationsR, contigLen);
+
+        String<unsigned> outsideR;
+        if (!parse_bamContig(contigObservationsF, contigObservationsR, outsideR, bamStream, rID, indexOptions) && bamStream.unsorted)
+        {
+            out.close();
+            std::remove(toCString(indexFileName));
+            return false;
+        }
+        addTruncCounts(contigObservationsR, outsideR, indexOptions.maxTruncCount2);
+
+        offsetsF[rID] = out.tellp();
+        writeTruncCounts(out, contigObservationsF);
+        offsetsR[rID] = out.tellp();
+        writeTruncCounts(out, contigObservationsR);
+    }
+
+    dirOffset = out.tellp();
+    for (unsigned rID = 0; rID < contigNo; ++rID)
+    {
+        CharString const &name = contigNames(context(bamStream.inFile))[rID];
+        __uint32 nameLength = length(name);
+        __uint32 contigLen = contigLengths(context(bamStream.inFile))[rID];
+        out.write(reinterpret_cast<char const *>(&nameLength), sizeof(nameLength));
+        out.write(toCString(name), nameLength);
+        out.write(reinterpret_cast<char const *>(&contigLen), sizeof(contigLen));
+        out.write(reinterpret_cast<char const *>(&offsetsF[rID]), sizeof(__uint64));
+        out.write(reinterpret_cast<char const *>(&offsetsR[rID]), sizeof(__uint64));
+    }
+    out.seekp(20);
+    out.write(reinterpret_cast<char const *>(&dirOffset), sizeof(dirOffset));
+    if (!out.good())
+    {
+        std::cerr << "ERROR: Could not write read start count index " << indexFileName << ".\n";
+        return false;
+    }
+    return true;
+}
+
+
+#endif
@@ -27,8 +27,17 @@
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cfloat>
+#include <algorithm>
+#include <vector>
+#include <random>
 #include <seqan/bed_io.h>
 
+#include <gsl/gsl_fft_real.h>
+#include <gsl/gsl_fft_halfcomplex.h>
+
 #include <math.h>    
 
 using namespace seqan;
@@ -76,6 +85,52 @@ namespace seqan {
             }
     }; 
 
+    // log-sum-exp with small table of log(1 + exp(d)) for d in [minValue, 0] and linear interpolation (~37 KB, stays in cache)
+    // NOTE: only for finite values, NaN/inf have to be handled by caller
+    class LogSumExp_interpTable
+    {
+        public:
+            double minValue;
+            double scale;       // table entries per unit
+            unsigned size;
+            String<double> table;
+
+            LogSumExp_interpTable(double minValue_ = -36.0, unsigned stepsPerUnit = 128) : minValue(minValue_), scale(stepsPerUnit)
+            {
+                size = (unsigned)(-minValue * stepsPerUnit);
+                resize(table, size + 2, Exact());
+                for (unsigned j = 0; j <= size; ++j)
+                    table[j] = log1p(exp(minValue + j/scale));
+                table[0] = 0.0;                 // d <= minValue: returning larger value
+                table[size + 1] = table[size];  // interpolation at d = 0
+            }
+
+            // max. value plus interpolated log(1 + exp(min - max)), without branches
+            template <typename TValue>
+            TValue logSumExp_add(TValue f1, TValue f2) const
+            {
+                TValue m = std::max(f1, f2);
+                double d = std::min(f1, f2) - m;
+                double x = (std::max(d, minValue) - minValue) * scale;
+                unsigned j = (unsigned)x;
+                double frac = x - j;
+                return m + (table[j] + frac * (table[j + 1] - table[j]));
+            }
+
+            // pairwise reduction over states, for K = 4: (f0 + f1) + (f2 + f3) with independent first additions
+            template <unsigned K, typename TValue>
+            TValue logSumExp_states(TValue const (&fs)[K]) const
+            {
+                TValue sums[K];
+                for (unsigned k = 0; k < K; ++k)
+                    sums[k] = fs[k];
+                for (unsigned w = 1; w < K; w *= 2)
+                    for (unsigned k = 0; k + w < K; k += 2*w)
+                        sums[k] = logSumExp_add(sums[k], sums[k + w]);
+                return sums[0];
+            }
+    };
+
     struct AppOptions
     {
         String<CharString> bamFileNames;
@@ -123,6 +178,8 @@ namespace seqan {
 
         bool gaussianKernel;
         bool epanechnikovKernel;
+        String<double> kernelDensities;     // K(d/h) at position d <= 4*bandwidth, set by initKernelDensities()
+        String<double> kernelDensitiesN;    // same for custom kernel with bandwidthN
         double useKdeThreshold;
 
         bool estimateNfromKdes;
@@ -158,10 +215,16 @@ namespace seqan {
         unsigned distMerge;
         bool use_pseudoEProb;
         bool useHighPrecision;      // long double to compute emission probabilities, state posteriors, Forward-Backward (alpha, beta) values
-        LogSumExp_lookupTable lookUp;   // table containing log-sum-exp precomputed values to avoid expensive log and exp operations
-        unsigned lookupTable_size;
+        bool validateFB;            // run Forward-Backward additionally in log-space and long double and report max. deviation of state posteriors
+        bool scaledFB;              // Forward-Backward with scaled probabilities instead of log-space
+        LogSumExp_interpTable lookUp;   // table containing log-sum-exp precomputed values to avoid expensive log and exp operations
+        unsigned lookupTable_size;      // previous look-up table (without interpolation), only used as reference by 'pureclip benchmark-lse'
         double lookupTable_minValue;
         unsigned selectRead;
+        bool streamBam;
+        unsigned parseRegionSize;
+        unsigned cacheMemory;
+        bool useTruncCountIndex;
 
         unsigned numThreads;
         unsigned numThreadsA;
@@ -225,9 +288,15 @@ namespace seqan {
             distMerge(8),
             use_pseudoEProb(false),          // when including replicates, add pseudo eProb to avoid crosslink eprobs of 0.0 !
             useHighPrecision(false),
+            validateFB(false),
+            scaledFB(false),
             lookupTable_size(600000),
             lookupTable_minValue(-2000.0),
             selectRead(0),
+            streamBam(false),                // parse target BAM files once from start to end instead of jumping to contigs via BAI index
+            parseRegionSize(16000000),       // large contigs are split into regions of this size, which are decoded from BAM in parallel
+            cacheMemory(0),                  // memory (MB) to keep read start counts of learning contigs for application, 0: no limit
+            useTruncCountIndex(false),       // target files are read start count indices (.pctc) instead of BAM files
             numThreads(1),
             numThreadsA(0),
             outputAll(false),
@@ -260,6 +329,68 @@ namespace seqan {
         {}
     };
 
+    // log-sum-exp over 4 states: throughput and max. absolute error against long double of
+    // previous look-up table (-ts, -tmv) and interpolated table used for forward-backward
+    void benchmarkLogSumExp(unsigned n, AppOptions const &options)
+    {
+        LogSumExp_lookupTable lookupTable(options.lookupTable_size, options.lookupTable_minValue);
+        LogSumExp_interpTable const &interpTable = options.lookUp;
+
+        // log-values as in forward-backward: large common offset, differences between states of different magnitude
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<double> offsetDist(-5000.0, 0.0);
+        std::normal_distribution<double> diffDist(0.0, 5.0);
+        String<double> fs;
+        String<long double> exact;
+        resize(fs, 4 * n, Exact());
+        resize(exact, n, Exact());
+        for (unsigned i = 0; i < n; ++i)
+        {
+            double offset = offsetDist(rng);
+            for (unsigned k = 0; k < 4; ++k)
+                fs[i*4 + k] = offset + diffDist(rng) * (k + 1);
+
+            long double m = std::max(std::max(fs[i*4], fs[i*4 + 1]), std::max(fs[i*4 + 2], fs[i*4 + 3]));
+            long double sum = 0.0;
+            for (unsigned k = 0; k < 4; ++k)
+                sum += expl(fs[i*4 + k] - m);
+            exact[i] = m + logl(sum);
+        }
+
+        String<long double> res;
+        resize(res, n, Exact());
+
+        double timeStamp = sysTime();
+        for (unsigned i = 0; i < n; ++i)
+        {
+            long double sum = fs[i*4];
+            for (unsigned k = 1; k < 4; ++k)
+                sum = lookupTable.logSumExp_add(sum, (long double)fs[i*4 + k]);
+            res[i] = sum;
+        }
+        double timeLookup = sysTime() - timeStamp;
+        long double maxErrLookup = 0.0;
+        for (unsigned i = 0; i < n; ++i)
+            maxErrLookup = std::max(maxErrLookup, std::fabs(res[i] - exact[i]));
+
+        timeStamp = sysTime();
+        for (unsigned i = 0; i < n; ++i)
+        {
+            double f[4] = {fs[i*4], fs[i*4 + 1], fs[i*4 + 2], fs[i*4 + 3]};
+            res[i] = interpTable.logSumExp_states(f);
+        }
+        double timeInterp = sysTime() - timeStamp;
+        long double maxErrInterp = 0.0;
+        for (unsigned i = 0; i < n; ++i)
+            maxErrInterp = std::max(maxErrInterp, std::fabs(res[i] - exact[i]));
+
+        std::cout << "Log-sum-exp over 4 states, " << n << " times:" << std::endl;
+        std::cout << "    look-up table (size: " << lookupTable.size << ", min. value: " << lookupTable.minValue << "): " 
+                  << (timeLookup * 1e9 / n) << " ns per sum, max. absolute error: " << maxErrLookup << std::endl;
+        std::cout << "    interpolated table (size: " << length(interpTable.table) << ", min. value: " << interpTable.minValue << "): " 
+                  << (timeInterp * 1e9 / n) << " ns per sum, max. absolute error: " << maxErrInterp << std::endl;
+    }
+
     template <typename TGAMMA, typename TBIN>
     struct ModelParams {
 
@@ -284,36 +415,594 @@ namespace seqan {
 
 
 
+    // reference contigs: names and lengths are taken from the FAI index, sequences are read on demand from the (memory-mapped) FASTA file
+    // NOTE: gzip compressed FASTA files cannot be indexed, their sequences are loaded completely
+    struct ReferenceStore {
+        StringSet<CharString>   contigNameStore;
+        String<unsigned>        contigLengths;
+        CharString              refFileName;
+        bool                    useFai;
+        StringSet<Dna5String>   contigSeqs;     // only if not using FAI index
+
+        ReferenceStore() : useFai(false) {}
+    };
+
+    bool loadReference(ReferenceStore &store, CharString const &refFileName)
+    {
+        clear(store.contigNameStore);
+        clear(store.contigLengths);
+        clear(store.contigSeqs);
+        store.refFileName = refFileName;
+
+        std::string fileName = toCString(refFileName);
+        store.useFai = !(fileName.size() > 3 && fileName.compare(fileName.size() - 3, 3, ".gz") == 0);
+        if (store.useFai)
+        {
+            FaiIndex faiIndex;      // sequences are read via ReferenceReader
+            if (!open(faiIndex, toCString(refFileName)))
+            {
+                CharString faiFileName = refFileName;
+                append(faiFileName, ".fai");
+                if (!build(faiIndex, toCString(refFileName), toCString(faiFileName)))
+                {
+                    std::cerr << "ERROR: Could not build FAI index for reference file '" << refFileName << "'" << std::endl;
+                    return false;
+                }
+                if (!save(faiIndex, toCString(faiFileName)))
+                    std::cout << "WARNING: Could not write FAI index " << faiFileName << ", index will be built again in next run." << std::endl;
+            }
+            for (unsigned contigId = 0; contigId < numSeqs(faiIndex); ++contigId)
+            {
+                appendValue(store.contigNameStore, sequenceName(faiIndex, contigId));
+                appendValue(store.contigLengths, sequenceLength(faiIndex, contigId));
+            }
+            return true;
+        }
+
+        SeqFileIn seqIn;
+        if (!open(seqIn, toCString(refFileName)))
+        {
+            std::cerr << "ERROR: Could not open reference file '" << refFileName << "'" << std::endl;
+            return false;
+        }
+        CharString contigName;
+        Dna5String contigSeq;
+        while (!atEnd(seqIn))
+        {
+            readRecord(contigName, contigSeq, seqIn);
+            cropAfterFirst(contigName, IsWhitespace());
+            appendValue(store.contigNameStore, contigName);
+            appendValue(store.contigLengths, length(contigSeq));
+            appendValue(store.contigSeqs, contigSeq);
+        }
+        return true;
+    }
+
+    inline unsigned contigLength(ReferenceStore const &store, unsigned contigId)
+    {
+        return store.contigLengths[contigId];
+    }
+
+    // access to reference sequences for one thread: own FAI index and file mapping, i.e. readers can be used in parallel without locking
+    struct ReferenceReader {
+        ReferenceStore const *  store;
+        FaiIndex                faiIndex;
+
+        ReferenceReader() : store(NULL) {}
+    };
+
+    bool open(ReferenceReader &reader, ReferenceStore const &store)
+    {
+        reader.store = &store;
+        if (!store.useFai) return true;
+
+        if (!open(reader.faiIndex, toCString(store.refFileName)))
+        {
+            CharString faiFileName = store.refFileName;
+            append(faiFileName, ".fai");
+            if (!build(reader.faiIndex, toCString(store.refFileName), toCString(faiFileName)))
+            {
+                std::cerr << "ERROR: Could not build FAI index for reference file '" << store.refFileName << "'" << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // sequence of contig within [beginPos, endPos), clipped to contig
+    void getSequence(Dna5String &seq, ReferenceReader &reader, unsigned contigId, int beginPos, int endPos)
+    {
+        ReferenceStore const &store = *reader.store;
+        beginPos = std::max(beginPos, 0);
+        endPos = std::min(endPos, (int)contigLength(store, contigId));
+        clear(seq);
+        if (beginPos >= endPos) return;
+
+        if (store.useFai)
+            readRegion(seq, reader.faiIndex, contigId, (unsigned)beginPos, (unsigned)endPos);
+        else
+            seq = infix(store.contigSeqs[contigId], beginPos, endPos);
+    }
+
+
+    // read start counts of one contig strand, sparse: sorted positions with counts > 0 (forward coordinates for both strands)
     struct ContigObservations {
-        String<__uint16> truncCounts; 
+        String<__uint32>    positions;
+        String<__uint16>    counts;
+        unsigned            contigLength;
+
+        ContigObservations() : contigLength(0) {}
+    };
+
+    void init(ContigObservations &contigObservations, unsigned contigLength)
+    {
+        clear(contigObservations.positions);
+        clear(contigObservations.counts);
+        contigObservations.contigLength = contigLength;
+    }
+
+    void clear(ContigObservations &contigObservations)
+    {
+        init(contigObservations, 0);
+    }
+
+    inline bool empty(ContigObservations const &contigObservations)
+    {
+        return empty(contigObservations.positions);
+    }
+
+    // add count at position pos >= last position, counts larger maxTruncCount are truncated
+    inline void appendTruncCount(ContigObservations &contigObservations, unsigned pos, unsigned count, unsigned maxTruncCount)
+    {
+        if (!empty(contigObservations.positions) && back(contigObservations.positions) == pos)
+        {
+            back(contigObservations.counts) = std::min((unsigned)back(contigObservations.counts) + count, maxTruncCount);
+            return;
+        }
+        appendValue(contigObservations.positions, pos, Generous());
+        appendValue(contigObservations.counts, std::min(count, maxTruncCount), Generous());
+    }
+
+    // append observations of following region
+    void append(ContigObservations &contigObservations, ContigObservations const &regionObservations, unsigned maxTruncCount)
+    {
+        for (unsigned j = 0; j < length(regionObservations.positions); ++j)
+            appendTruncCount(contigObservations, regionObservations.positions[j], regionObservations.counts[j], maxTruncCount);
+    }
+
+    // add read starts at unsorted positions (e.g. collected outside of parsed regions), positions >= contigLength are ignored
+    void addTruncCounts(ContigObservations &contigObservations, String<unsigned> truncPositions, unsigned maxTruncCount)
+    {
+        if (empty(truncPositions)) return;
+        std::sort(begin(truncPositions, Standard()), end(truncPositions, Standard()));
+
+        ContigObservations merged;
+        init(merged, contigObservations.contigLength);
+        reserve(merged.positions, length(contigObservations.positions) + length(truncPositions), Exact());
+        reserve(merged.counts, length(contigObservations.positions) + length(truncPositions), Exact());
+        unsigned j = 0;
+        for (unsigned k = 0; k < length(truncPositions) && truncPositions[k] < contigObservations.contigLength; ++k)
+        {
+            for (; j < length(contigObservations.positions) && contigObservations.positions[j] <= truncPositions[k]; ++j)
+                appendTruncCount(merged, contigObservations.positions[j], contigObservations.counts[j], maxTruncCount);
+            appendTruncCount(merged, truncPositions[k], 1, maxTruncCount);
+        }
+        for (; j < length(contigObservations.positions); ++j)
+            appendTruncCount(merged, contigObservations.positions[j], contigObservations.counts[j], maxTruncCount);
+
+        move(contigObservations.positions, merged.positions);
+        move(contigObservations.counts, merged.counts);
+    }
+
+    // index of first covered position >= pos
+    inline unsigned lowerBound(ContigObservations const &contigObservations, unsigned pos)
+    {
+        return std::lower_bound(begin(contigObservations.positions, Standard()), end(contigObservations.positions, Standard()), pos) - begin(contigObservations.positions, Standard());
+    }
+
+    // first covered position within [pos, end), end if none
+    inline unsigned nextCoveredPos(ContigObservations const &contigObservations, unsigned pos, unsigned end)
+    {
+        unsigned j = lowerBound(contigObservations, pos);
+        if (j < length(contigObservations.positions))
+            return std::min((unsigned)contigObservations.positions[j], std::max(pos, end));
+        return std::max(pos, end);
+    }
+
+    // end of run of consecutive covered positions starting at pos, limited to end (pos if not covered)
+    inline unsigned coveredRunEnd(ContigObservations const &contigObservations, unsigned pos, unsigned end)
+    {
+        unsigned j = lowerBound(contigObservations, pos);
+        while (pos < end && j < length(contigObservations.positions) && contigObservations.positions[j] == pos)
+        {
+            ++pos;
+            ++j;
+        }
+        return pos;
+    }
+
+    // dense counts within [c1, c2)
+    void getTruncCounts(String<__uint16> &truncCounts, ContigObservations const &contigObservations, unsigned c1, unsigned c2)
+    {
+        clear(truncCounts);
+        resize(truncCounts, c2 - c1, 0, Exact());
+        for (unsigned j = lowerBound(contigObservations, c1); j < length(contigObservations.positions) && contigObservations.positions[j] < c2; ++j)
+            truncCounts[contigObservations.positions[j] - c1] = contigObservations.counts[j];
+    }
+
+
+    // view on reverse strand observations (stored in forward coordinates) in reverse strand coordinates t_R = len - t - 1
+    // NOTE: avoids reversing contig arrays, coordinates are mapped back when writing sites and regions
+    struct ReverseContigObservations {
+        ContigObservations const &contigObservations;
+
+        ReverseContigObservations(ContigObservations const &_contigObservations) : contigObservations(_contigObservations) {}
+    };
+
+    // index of first covered position > pos (in forward coordinates)
+    inline unsigned upperBound(ContigObservations const &contigObservations, unsigned pos)
+    {
+        return std::upper_bound(begin(contigObservations.positions, Standard()), end(contigObservations.positions, Standard()), pos) - begin(contigObservations.positions, Standard());
+    }
+
+    inline unsigned nextCoveredPos(ReverseContigObservations const &reverseObservations, unsigned pos, unsigned end)
+    {
+        ContigObservations const &obs = reverseObservations.contigObservations;
+        if (pos >= end) return pos;
+        unsigned j = upperBound(obs, obs.contigLength - pos - 1);
+        if (j > 0)
+            return std::min(obs.contigLength - obs.positions[j - 1] - 1, end);
+        return end;
+    }
+
+    inline unsigned coveredRunEnd(ReverseContigObservations const &reverseObservations, unsigned pos, unsigned end)
+    {
+        ContigObservations const &obs = reverseObservations.contigObservations;
+        if (pos >= end) return pos;
+        unsigned j = upperBound(obs, obs.contigLength - pos - 1);
+        while (pos < end && j > 0 && obs.positions[j - 1] == obs.contigLength - pos - 1)
+        {
+            ++pos;
+            --j;
+        }
+        return pos;
+    }
+
+    void getTruncCounts(String<__uint16> &truncCounts, ReverseContigObservations const &reverseObservations, unsigned c1, unsigned c2)
+    {
+        ContigObservations const &obs = reverseObservations.contigObservations;
+        clear(truncCounts);
+        resize(truncCounts, c2 - c1, 0, Exact());
+        for (unsigned j = lowerBound(obs, obs.contigLength - c2); j < length(obs.positions) && obs.positions[j] < obs.contigLength - c1; ++j)
+            truncCounts[obs.contigLength - obs.positions[j] - 1 - c1] = obs.counts[j];
+    }
+
+    // background signal record (-is), positions in forward coordinates
+    struct CovariateRecord {
+        __uint32    beginPos;
+        __uint32    endPos;
+        __uint32    recordNo;       // order within BED file
+        double      score;
+    };
+
+    inline bool operator<(CovariateRecord const &a, CovariateRecord const &b)
+    {
+        return a.beginPos < b.beginPos;
+    }
+
+    // background signal records of one contig strand, sorted by begin position
+    struct CovariateIntervals {
+        String<CovariateRecord> records;
+        String<__uint32>        maxEndPos;      // max. end position of records up to this one
+    };
+
+    // motif hit (-fis), position in forward coordinates
+    struct MotifHit {
+        __uint32    pos;
+        float       score;
+        char        motifId;
+    };
+
+    inline bool operator<(MotifHit const &a, MotifHit const &b)
+    {
+        return a.pos < b.pos;
+    }
+
+    // covariates parsed once from BED files, queried for covered intervals
+    struct Covariates {
+        String<String<CovariateIntervals> >     rpkmIntervals;      // contigId:F/R
+        String<String<String<MotifHit> > >      motifHits;          // contigId:F/R, sorted by position
+    };
+
+    void sortRecords(CovariateIntervals &covIntervals)
+    {
+        std::stable_sort(begin(covIntervals.records, Standard()), end(covIntervals.records, Standard()));
+        resize(covIntervals.maxEndPos, length(covIntervals.records), Exact());
+        __uint32 maxEndPos = 0;
+        for (unsigned k = 0; k < length(covIntervals.records); ++k)
+        {
+            maxEndPos = std::max(maxEndPos, covIntervals.records[k].endPos);
+            covIntervals.maxEndPos[k] = maxEndPos;
+        }
+    }
+
+    inline bool lessRecordNo(CovariateRecord const *a, CovariateRecord const *b)
+    {
+        return a->recordNo < b->recordNo;
+    }
+
+    // motif scores and ids within [c1, c2) (reverse strand coordinates if reverseStrand)
+    // NOTE: if several hits are given for one position, the last one in the BED file is used
+    void getMotifScores(String<float> &fimoScores, String<char> &motifIds, String<MotifHit> const &motifHits, unsigned contigLength, unsigned c1, unsigned c2, bool reverseStrand)
+    {
+        clear(fimoScores);
+        clear(motifIds);
+        resize(fimoScores, c2 - c1, 0.0, Exact());
+        resize(motifIds, c2 - c1, 0, Exact());
+
+        MotifHit bHit;
+        bHit.pos = (reverseStrand) ? (contigLength - c2) : c1;     // forward coordinates
+        unsigned e = (reverseStrand) ? (contigLength - c1) : c2;
+        for (unsigned k = std::lower_bound(begin(motifHits, Standard()), end(motifHits, Standard()), bHit) - begin(motifHits, Standard()); 
+             k < length(motifHits) && motifHits[k].pos < e; ++k)
+        {
+            unsigned t = (reverseStrand) ? (contigLength - motifHits[k].pos - 1 - c1) : (motifHits[k].pos - c1);
+            fimoScores[t] = motifHits[k].score;
+            motifIds[t] = motifHits[k].motifId;
+        }
+    }
+
+    // background signal covariates within [c1, c2) (reverse strand coordinates if reverseStrand)
+    // NOTE: positions covered by several records are assigned in order of the BED file (first score, then max. score)
+    template <typename TOptions>
+    void getRpkms(String<double> &rpkms, CovariateIntervals const &covIntervals, unsigned contigLength, unsigned c1, unsigned c2, bool reverseStrand, TOptions const &options)
+    {
+        double minRPKM = 0.0;
+        if (options.useLogRPKM) 
+            minRPKM = options.minRPKMtoFit - 1.0; 
+        clear(rpkms);
+        resize(rpkms, c2 - c1, minRPKM, Exact());
+
+        unsigned b = (reverseStrand) ? (contigLength - c2) : c1;     // forward coordinates
+        unsigned e = (reverseStrand) ? (contigLength - c1) : c2;
+
+        // overlapping records
+        std::vector<CovariateRecord const *> overlapping;
+        unsigned k = std::upper_bound(begin(covIntervals.maxEndPos, Standard()), end(covIntervals.maxEndPos, Standard()), (__uint32)b) - begin(covIntervals.maxEndPos, Standard());
+        for (; k < length(covIntervals.records) && covIntervals.records[k].beginPos < e; ++k)
+            if (covIntervals.records[k].endPos > b)
+                overlapping.push_back(&covIntervals.records[k]);
+        std::sort(overlapping.begin(), overlapping.end(), lessRecordNo);
+
+        for (unsigned j = 0; j < overlapping.size(); ++j)
+        {
+            double score = overlapping[j]->score;
+            if (options.useLogRPKM  && score > 0.0)
+                score = log(score);
+            else if (options.useLogRPKM)
+                score = minRPKM;
+
+            for (unsigned p = std::max((unsigned)overlapping[j]->beginPos, b); p < std::min((unsigned)overlapping[j]->endPos, e); ++p)
+            {
+                unsigned t = (reverseStrand) ? (contigLength - p - 1 - c1) : (p - c1);
+                if (rpkms[t] == minRPKM)
+                    rpkms[t] = score;
+                else
+                    rpkms[t] = std::max(score, rpkms[t]);
+            }
+        }
+    }
+
+
+    // write read start counts in sparse binary format: no. of covered positions n, followed by n position deltas (__uint32) and n counts (__uint16)
+    void writeTruncCounts(std::ostream &out, ContigObservations const &contigObservations)
+    {
+        __uint32 n = length(contigObservations.positions);
+        out.write(reinterpret_cast<char const *>(&n), sizeof(n));
+        if (n == 0) return;
+
+        String<__uint32> deltas;
+        resize(deltas, n, Exact());
+        __uint32 prevPos = 0;
+        for (unsigned j = 0; j < n; ++j)
+        {
+            deltas[j] = contigObservations.positions[j] - prevPos;
+            prevPos = contigObservations.positions[j];
+        }
+        out.write(reinterpret_cast<char const *>(&deltas[0]), n * sizeof(__uint32));
+        out.write(reinterpret_cast<char const *>(&contigObservations.counts[0]), n * sizeof(__uint16));
+    }
+
+    // counts above maxTruncCount are truncated
+    bool readTruncCounts(ContigObservations &contigObservations, std::istream &in, unsigned contigLength, unsigned maxTruncCount = 65535)
+    {
+        init(contigObservations, contigLength);
+        __uint32 n = 0;
+        in.read(reinterpret_cast<char *>(&n), sizeof(n));
+        if (!in.good()) return false;
+        if (n == 0) return true;
+
+        resize(contigObservations.positions, n, Exact());
+        resize(contigObservations.counts, n, Exact());
+        in.read(reinterpret_cast<char *>(&contigObservations.positions[0]), n * sizeof(__uint32));
+        in.read(reinterpret_cast<char *>(&contigObservations.counts[0]), n * sizeof(__uint16));
+        if (!in.good()) return false;
+
+        __uint32 pos = 0;
+        for (unsigned j = 0; j < n; ++j)
+        {
+            pos += contigObservations.positions[j];
+            if (pos >= contigLength || contigObservations.counts[j] == 0) return false;
+            contigObservations.positions[j] = pos;
+            contigObservations.counts[j] = std::min((unsigned)contigObservations.counts[j], maxTruncCount);
+        }
+        return true;
+    }
+
+
+    // Cache for read start counts of contigs parsed while learning, to be reused when applying the model
+    // NOTE: if memory budget is exceeded, counts are written to temporary files
+    class TruncCountCache
+    {
+        public:
+            // 0: not cached, 1: cached in memory, 2: written to file, 3: no alignments
+            String<String<char> >                  status;       // rep:contigId
+            String<String<ContigObservations> >    contigObservationsF;
+            String<String<ContigObservations> >    contigObservationsR;
+            unsigned long   memoryUsed;
+            unsigned long   memoryBudget;   // in bytes, 0: no limit
+            CharString      filePrefix;
+
+            TruncCountCache() : memoryUsed(0), memoryBudget(0) {}
+
+            TruncCountCache(unsigned repNo, unsigned contigNo, unsigned long memoryBudget_, CharString const &filePrefix_) : 
+                memoryUsed(0), 
+                memoryBudget(memoryBudget_),
+                filePrefix(filePrefix_)
+            {
+                resize(status, repNo, Exact());
+                resize(contigObservationsF, repNo, Exact());
+                resize(contigObservationsR, repNo, Exact());
+                for (unsigned rep = 0; rep < repNo; ++rep)
+                {
+                    resize(status[rep], contigNo, 0, Exact());
+                    resize(contigObservationsF[rep], contigNo, Exact());
+                    resize(contigObservationsR[rep], contigNo, Exact());
+                }
+            }
+
+            ~TruncCountCache()
+            {
+                for (unsigned rep = 0; rep < length(status); ++rep)
+                    for (unsigned contigId = 0; contigId < length(status[rep]); ++contigId)
+                        if (status[rep][contigId] == 2) 
+                            std::remove(toCString(getFileName(rep, contigId)));
+            }
+
+            CharString getFileName(unsigned rep, unsigned contigId) const
+            {
+                std::stringstream ss;
+                ss << filePrefix << ".rep" << rep << ".contig" << contigId << ".tc.tmp";
+                return ss.str();
+            }
+
+            // takes over the counts, result: as returned by loadObservations()
+            void put(unsigned rep, unsigned contigId, ContigObservations &contigObsF, ContigObservations &contigObsR, int result);
+            // returns false if not cached
+            bool get(ContigObservations &contigObsF, ContigObservations &contigObsR, int &result, unsigned rep, unsigned contigId);
     };
 
-    void reverse(ContigObservations &contigObservations)
-    {    
-        reverse(contigObservations.truncCounts); 
+    void TruncCountCache::put(unsigned rep, unsigned contigId, ContigObservations &contigObsF, ContigObservations &contigObsR, int result)
+    {
+        if (result == 1) return;
+        if (status[rep][contigId] != 0) return;     // contig given multiple times, already cached
+        if (result == 2)
+        {
+            status[rep][contigId] = 3;
+            return;
+        }
+        unsigned long size = (length(contigObsF.positions) + length(contigObsR.positions)) * (sizeof(__uint32) + sizeof(__uint16));
+        bool inMemory = false;
+        SEQAN_OMP_PRAGMA(critical (truncCountCache))
+        {
+            if (memoryBudget == 0 || memoryUsed + size <= memoryBudget)
+            {
+                memoryUsed += size;
+                inMemory = true;
+            }
+        }
+        if (inMemory)
+        {
+            contigObservationsF[rep][contigId].contigLength = contigObsF.contigLength;
+            contigObservationsR[rep][contigId].contigLength = contigObsR.contigLength;
+            move(contigObservationsF[rep][contigId].positions, contigObsF.positions);
+            move(contigObservationsF[rep][contigId].counts, contigObsF.counts);
+            move(contigObservationsR[rep][contigId].positions, contigObsR.positions);
+            move(contigObservationsR[rep][contigId].counts, contigObsR.counts);
+            status[rep][contigId] = 1;
+            return;
+        }
+
+        std::ofstream out(toCString(getFileName(rep, contigId)), std::ios::binary);
+        if (!out.good())
+            return;     // not cached, parse again later
+        __uint32 contigLength = contigObsF.contigLength;
+        out.write(reinterpret_cast<char const *>(&contigLength), sizeof(contigLength));
+        writeTruncCounts(out, contigObsF);
+        writeTruncCounts(out, contigObsR);
+        out.close();
+        if (out.good())
+            status[rep][contigId] = 2;
+        else
+            std::remove(toCString(getFileName(rep, contigId)));     // not cached, parse again later
+        clear(contigObsF);
+        clear(contigObsR);
+    }
+
+    bool TruncCountCache::get(ContigObservations &contigObsF, ContigObservations &contigObsR, int &result, unsigned rep, unsigned contigId)
+    {
+        if (rep >= length(status) || contigId >= length(status[rep]) || status[rep][contigId] == 0)
+            return false;
+
+        if (status[rep][contigId] == 3)
+        {
+            result = 2;
+            return true;
+        }
+        if (status[rep][contigId] == 1)
+        {
+            contigObsF.contigLength = contigObservationsF[rep][contigId].contigLength;
+            contigObsR.contigLength = contigObservationsR[rep][contigId].contigLength;
+            move(contigObsF.positions, contigObservationsF[rep][contigId].positions);
+            move(contigObsF.counts, contigObservationsF[rep][contigId].counts);
+            move(contigObsR.positions, contigObservationsR[rep][contigId].positions);
+            move(contigObsR.counts, contigObservationsR[rep][contigId].counts);
+            SEQAN_OMP_PRAGMA(critical (truncCountCache))
+            memoryUsed -= (length(contigObsF.positions) + length(contigObsR.positions)) * (sizeof(__uint32) + sizeof(__uint16));
+        }
+        else
+        {
+            CharString fileName = getFileName(rep, contigId);
+            std::ifstream in(toCString(fileName), std::ios::binary);
+            __uint32 contigLength = 0;
+            in.read(reinterpret_cast<char *>(&contigLength), sizeof(contigLength));
+            bool ok = in.good() && readTruncCounts(contigObsF, in, contigLength) && readTruncCounts(contigObsR, in, contigLength);
+            in.close();
+            std::remove(toCString(fileName));
+            if (!ok)
+            {
+                std::cerr << "WARNING: Could not read cached read start counts from " << fileName << ", parsing BAM file again." << std::endl;
+                status[rep][contigId] = 0;
+                return false;
+            }
+        }
+        status[rep][contigId] = 0;
+        result = 0;
+        return true;
     }
 
 
     // workaround because partially specialized member function are forbidden
     // wrapper class for observations
     struct Observations {
-        Infix<String<__uint16> >::Type truncCounts;
+        String<__uint16>    truncCounts;    // dense counts of covered interval
         unsigned contigId; 
 
         String<__uint32>    nEstimates;      
         String<double>      kdes;       // used for 'enriched'. 'non-enriched' classification
         String<double>      kdesN;    // used to estimate the binomial n parameters (decoupled, might be useful e.g. for longer crosslink clusters) 
+        String<unsigned>    windowCounts;   // read starts within window of size ~ 2*bandwidthN, used to estimate the binomial n parameters
         String<double>      rpkms;      // change name -> e.g. bgSignal
         String<float>       fimoScores; // for each t: one motif score
         String<char>        motifIds; // for each t: one motif score
         bool                discard;    // NOTE: only use for application, not for learning!
 
-        Observations(Infix<String<__uint16> >::Type _truncCounts) : truncCounts(_truncCounts),
-                                                                    discard(false) {}
+        Observations(String<__uint16> const &_truncCounts) : truncCounts(_truncCounts),
+                                                             discard(false) {}
         Observations() : truncCounts(),
                          discard(false) {}
 
-        void estimateNs(AppOptions &options);                       // using raw counts
+        void estimateNs(AppOptions &/*options*/);                   // using raw counts
         void estimateNs(double b0, double b1, AppOptions /*&options*/); // using KDEs
         void computeKDEs(AppOptions &options);
         void computeKDEs(String<__uint16> &inputTruncCounts, AppOptions &options);    // input signal
@@ -326,19 +1015,12 @@ namespace seqan {
     }
 
     
-    void Observations::estimateNs(AppOptions &options)  
+    // NOTE: window counts have to be computed with computeKDEs() first
+    void Observations::estimateNs(AppOptions &/*options*/)  
     { 
         resize(this->nEstimates, length(), Exact());
-        unsigned w_50 = floor((double)options.bandwidthN - 0.1);    // binSize should be odd
-
         for (unsigned t = 0; t < length(); ++t)
-        {
-            unsigned sum = 0;
-            for (unsigned j = std::max((int)t - (int)w_50, (int)0); (j < length()) && (j <= t + w_50); ++j)  // inefficient... update on the fly
-                sum += this->truncCounts[j];
-            
-             this->nEstimates[t] = std::max(sum, (unsigned)1); 
-        }
+            this->nEstimates[t] = std::max(this->windowCounts[t], (unsigned)1); 
     }
 
     // use simple linear regression, estimate from KDE values
@@ -391,57 +1073,273 @@ namespace seqan {
         return (fac1 * exp(fac2/2.0));
     }
 
-    void Observations::computeKDEs(AppOptions &options)
+    // precompute kernel densities   -> K(d/h) store at position d
+    void initKernelDensities(AppOptions &options)
     {
-        resize(this->kdes, length());
-
         unsigned w_50 = options.bandwidth * 4;
-        // precompute kernel densities
-        String<double> kernelDensities;
-        resize(kernelDensities, w_50 + 1, 0.0);
-
-        // precompute kernel densities   -> K(d/h) store at position d
+        clear(options.kernelDensities);
+        resize(options.kernelDensities, w_50 + 1, 0.0, Exact());
         for (unsigned i = 0; i <= w_50; ++i)
         {
             if (options.gaussianKernel)
-                kernelDensities[i] = getGaussianKernelDensity((double)i/(double)options.bandwidth);
+                options.kernelDensities[i] = getGaussianKernelDensity((double)i/(double)options.bandwidth);
             else if (options.epanechnikovKernel)
-                kernelDensities[i] = getEpanechnikovKernelDensity((double)i/(double)options.bandwidth);        
+                options.kernelDensities[i] = getEpanechnikovKernelDensity((double)i/(double)options.bandwidth);        
         }
-        for (unsigned t = 0; t < length(); ++t)
+
+        // TODO problem: interval size dependent on main bandwidth parameter, 
+        w_50 = options.bandwidthN * 4;
+        clear(options.kernelDensitiesN);
+        resize(options.kernelDensitiesN, w_50 + 1, 0.0, Exact());
+        for (unsigned i = 0; i <= w_50; ++i)
+            options.kernelDensitiesN[i] = getCustomKernelDensity((double)i/(double)options.bandwidthN, options);      
+    }
+
+    // dot product with independent partial sums, vectorized by the compiler
+    // NOTE: on Linux x86-64 (GCC) versions for AVX-512 and AVX2 are compiled additionally and chosen at runtime
+#if defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 6) && defined(__x86_64__) && defined(__linux__)
+    __attribute__((target_clones("avx512f", "avx2", "default")))
+#endif
+    double dotProduct(double const *x, double const *y, unsigned len)
+    {
+        double partialSums[8] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+        unsigned i = 0;
+        for (; i + 8 <= len; i += 8)
+            for (unsigned j = 0; j < 8; ++j)
+                partialSums[j] += x[i + j] * y[i + j];
+        double sum = 0.0;
+        for (; i < len; ++i)
+            sum += x[i] * y[i];
+        for (unsigned j = 0; j < 8; ++j)
+            sum += partialSums[j];
+        return sum;
+    }
+
+    // same with window size known at compile time (fully unrolled)
+    template <unsigned LEN>
+    inline double dotProduct(double const *x, double const *y)
+    {
+        double partialSums[8] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+        for (unsigned i = 0; i + 8 <= LEN; i += 8)
+            for (unsigned j = 0; j < 8; ++j)
+                partialSums[j] += x[i + j] * y[i + j];
+        double sum = 0.0;
+        for (unsigned i = LEN - LEN % 8; i < LEN; ++i)
+            sum += x[i] * y[i];
+        for (unsigned j = 0; j < 8; ++j)
+            sum += partialSums[j];
+        return sum;
+    }
+
+    // positions [w_50, n - w_50) with complete kernel window, for default bandwidths (-bdw 50, 100)
+    template <unsigned W_50>
+    void convolveKernelInner(String<double> &kde, std::vector<double> const &x, std::vector<double> const &mirroredKernel)
+    {
+        for (unsigned t = W_50; t + W_50 < x.size(); ++t)
+            kde[t] = dotProduct<2*W_50 + 1>(&x[t - W_50], &mirroredKernel[0]);
+    }
+
+    // kde[t] = sum_i counts[i] * kernel[|t - i|], for |t - i| < length(kernel)
+    template <typename TCounts>
+    void convolveKernelDirect(String<double> &kde, TCounts const &counts, String<double> const &kernel)
+    {
+        unsigned n = length(counts);
+        resize(kde, n, Exact());
+        if (n == 0) return;
+        unsigned w_50 = std::min((unsigned)length(kernel) - 1, n - 1);
+
+        // contiguous dot products: counts as double, kernel mirrored (mirroredKernel[w_50 + d] = K(|d|/h))
+        std::vector<double> x(n);
+        for (unsigned i = 0; i < n; ++i)
+            x[i] = counts[i];
+        std::vector<double> mirroredKernel(2*w_50 + 1);
+        for (unsigned d = 0; d <= w_50; ++d)
         {
-            double kde = 0.0;
-            for (unsigned i = std::max((int)t - (int)w_50, (int)0); (i < length()) && (i <= t + w_50); ++i)  // inefficient if low genome coverage and not selected only for covered regions!!!
-            { 
-                kde += this->truncCounts[i] * kernelDensities[(unsigned)std::abs((int)t - (int)i)];
-            }
-            this->kdes[t] = kde/(double)options.bandwidth; 
+            mirroredKernel[w_50 + d] = kernel[d];
+            mirroredKernel[w_50 - d] = kernel[d];
+        }
+
+        unsigned t1 = 0;        // [t1, t2) already computed
+        unsigned t2 = 0;
+        if (n > 2*w_50 && (w_50 == 200 || w_50 == 400))
+        {
+            if (w_50 == 200)
+                convolveKernelInner<200>(kde, x, mirroredKernel);
+            else
+                convolveKernelInner<400>(kde, x, mirroredKernel);
+            t1 = w_50;
+            t2 = n - w_50;
+        }
+        for (unsigned t = 0; t < n; ++t)
+        {
+            if (t == t1 && t1 < t2) t = t2;
+            if (t >= n) break;
+
+            unsigned i1 = (t > w_50) ? (t - w_50) : 0;
+            unsigned i2 = std::min(t + w_50 + 1, n);
+            kde[t] = dotProduct(&x[i1], &mirroredKernel[i1 + w_50 - t], i2 - i1);
+        }
+    }
+
+    // same, but only scattering the kernel around non-zero counts (sparse intervals)
+    template <typename TCounts>
+    void convolveKernelScatter(String<double> &kde, TCounts const &counts, String<double> const &kernel)
+    {
+        unsigned n = length(counts);
+        unsigned w_50 = length(kernel) - 1;
+        clear(kde);
+        resize(kde, n, 0.0, Exact());
+        for (unsigned i = 0; i < n; ++i)
+        {
+            if (counts[i] == 0) continue;
+
+            double count = counts[i];
+            unsigned t1 = (i > w_50) ? (i - w_50) : 0;
+            unsigned t2 = std::min(i + w_50 + 1, n);
+            for (unsigned t = t1; t < i; ++t)
+                kde[t] += count * kernel[i - t];
+            for (unsigned t = i; t < t2; ++t)
+                kde[t] += count * kernel[t - i];
         }
+    }
+
+    // same via FFT (GSL real radix-2 transforms), O(n log n) independent of bandwidth
+    template <typename TCounts>
+    void convolveKernelFFT(String<double> &kde, TCounts const &counts, String<double> const &kernel)
+    {
+        unsigned n = length(counts);
+        unsigned w_50 = std::min((unsigned)length(kernel) - 1, n - 1);     // larger distances not within interval
+        size_t fftSize = 1;
+        while (fftSize < n + w_50) fftSize <<= 1;                       // zero-padded, no wrap around of circular convolution
+
+        std::vector<double> x(fftSize, 0.0);
+        std::vector<double> k(fftSize, 0.0);
+        for (unsigned i = 0; i < n; ++i)
+            x[i] = counts[i];
+        k[0] = kernel[0];
+        for (unsigned d = 1; d <= w_50; ++d)
+        {
+            k[d] = kernel[d];
+            k[fftSize - d] = kernel[d];
+        }
+        gsl_fft_real_radix2_transform(&x[0], 1, fftSize);
+        gsl_fft_real_radix2_transform(&k[0], 1, fftSize);
+
+        // multiply in half-complex layout: real part at j, imaginary part at fftSize - j
+        x[0] *= k[0];
+        if (fftSize > 1) x[fftSize/2] *= k[fftSize/2];
+        for (size_t j = 1; j < fftSize/2; ++j)
+        {
+            double re = x[j] * k[j] - x[fftSize - j] * k[fftSize - j];
+            double im = x[j] * k[fftSize - j] + x[fftSize - j] * k[j];
+            x[j] = re;
+            x[fftSize - j] = im;
+        }
+        gsl_fft_halfcomplex_radix2_inverse(&x[0], 1, fftSize);
+
+        // remove rounding noise: positions without counts within kernel support have to stay exactly 0,
+        // otherwise KDE is at least smallest kernel weight times local count (as for direct convolution);
+        // values within rounding error of FFT are set to this bound (i.e. to 0 for zero weights within support)
+        unsigned w_nz = 0;
+        for (unsigned d = 0; d <= w_50; ++d)
+            if (kernel[d] > 0.0) w_nz = d;
+        double minWeight = kernel[0];
+        for (unsigned d = 1; d <= w_nz; ++d)
+            minWeight = std::min(minWeight, kernel[d]);
+        minWeight = std::max(minWeight, 0.0);       // zero weights within support: only clamp negative values
+        String<double> prefixSums;
+        resize(prefixSums, n + 1, Exact());
+        prefixSums[0] = 0.0;
+        for (unsigned i = 0; i < n; ++i)
+            prefixSums[i + 1] = prefixSums[i] + counts[i];
+
+        double maxValue = 0.0;
+        for (unsigned t = 0; t < n; ++t)
+            maxValue = std::max(maxValue, x[t]);
+        double noise = maxValue * DBL_EPSILON * std::max(log2((double)fftSize), 1.0);
+
+        resize(kde, n, Exact());
+        for (unsigned t = 0; t < n; ++t)
+        {
+            unsigned t1 = (t > w_nz) ? (t - w_nz) : 0;
+            unsigned t2 = std::min(t + w_nz + 1, n);
+            double localCount = prefixSums[t2] - prefixSums[t1];
+            if (localCount == 0.0)
+                kde[t] = 0.0;
+            else if (x[t] <= noise)
+                kde[t] = minWeight * localCount;
+            else
+                kde[t] = std::max(x[t], minWeight * localCount);
+        }
+    }
+
+    // throughput of vectorized direct convolution relative to scalar scatter and FFT operations
+    // (AVX2/AVX-512 versions of dotProduct only compiled with GCC on Linux x86-64, otherwise at most 2-wide)
+#if defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 6) && defined(__x86_64__) && defined(__linux__)
+    static const double DIRECT_SPEEDUP = 8.0;
+#else
+    static const double DIRECT_SPEEDUP = 2.0;
+#endif
+
+    // choose direct convolution, scatter or FFT, depending on fill ratio and expected costs
+    template <typename TCounts>
+    void convolveKernel(String<double> &kde, TCounts const &counts, String<double> const &kernel)
+    {
+        unsigned n = length(counts);
+        if (n == 0)
+        {
+            clear(kde);
+            return;
+        }
+        unsigned w_50 = std::min((unsigned)length(kernel) - 1, n - 1);
+        size_t fftSize = 1;
+        while (fftSize < n + w_50) fftSize <<= 1;
+        unsigned nonZero = 0;
+        for (unsigned i = 0; i < n; ++i)
+            if (counts[i] > 0) ++nonZero;
+
+        // direct: n * (2w + 1) multiply-adds, but vectorized dot products with 8 independent partial sums (DIRECT_SPEEDUP),
+        // scatter: (no. of non-zero counts) * (2w + 1), FFT: three real transforms of size N, ~ 8 N log2(N) operations
+        double costDirect = (double)n * (2*w_50 + 1) / DIRECT_SPEEDUP;
+        double costScatter = (double)nonZero * (2*w_50 + 1) + n;
+        double costFFT = 8.0 * fftSize * log2((double)fftSize);
+        if (costScatter <= costDirect && costScatter <= costFFT)
+            convolveKernelScatter(kde, counts, kernel);
+        else if (costFFT < costDirect)
+            convolveKernelFFT(kde, counts, kernel);
+        else
+            convolveKernelDirect(kde, counts, kernel);
+    }
+
+    // KDEs for 'enriched' classification and estimation of Ns, and window counts
+    // NOTE: kernel densities have to be initialized with initKernelDensities()
+    void Observations::computeKDEs(AppOptions &options)
+    {
+        convolveKernel(this->kdes, this->truncCounts, options.kernelDensities);
+        for (unsigned t = 0; t < length(); ++t)
+            this->kdes[t] /= (double)options.bandwidth; 
 
         /////////////////////////////////
         // same, but for kdes used for estimation of n
-        // TODO problem: interval size dependent on main bandwidth parameter, 
         /////////////////////////////////
-        resize(this->kdesN, length());
+        convolveKernel(this->kdesN, this->truncCounts, options.kernelDensitiesN);
+        for (unsigned t = 0; t < length(); ++t)
+            this->kdesN[t] /= (double)options.bandwidthN; 
 
-        w_50 = options.bandwidthN * 4;
-        // precompute kernel densities
-        clear(kernelDensities);
-        resize(kernelDensities, w_50 + 1, 0.0);
+        // raw read start counts within window, using prefix sums
+        unsigned w_50 = floor((double)options.bandwidthN - 0.1);    // binSize should be odd
+        String<unsigned> prefixSums;
+        resize(prefixSums, length() + 1, Exact());
+        prefixSums[0] = 0;
+        for (unsigned t = 0; t < length(); ++t)
+            prefixSums[t + 1] = prefixSums[t] + this->truncCounts[t];
 
-        // precompute kernel densities   -> K(d/h) store at position d
-        for (unsigned i = 0; i <= w_50; ++i)
-        {
-            kernelDensities[i] = getCustomKernelDensity((double)i/(double)options.bandwidthN, options);      
-        }
+        resize(this->windowCounts, length(), Exact());
         for (unsigned t = 0; t < length(); ++t)
         {
-            double kde = 0.0;
-            for (unsigned i = std::max((int)t - (int)w_50, (int)0); (i < length()) && (i <= t + w_50); ++i)  // inefficient if low genome coverage and not selected only for covered regions!!!
-            { 
-                kde += this->truncCounts[i] * kernelDensities[(unsigned)std::abs((int)t - (int)i)];
-            }
-            this->kdesN[t] = kde/(double)options.bandwidthN; 
+            unsigned j1 = (t > w_50) ? (t - w_50) : 0;
+            unsigned j2 = std::min(t + w_50 + 1, length());
+            this->windowCounts[t] = prefixSums[j2] - prefixSums[j1];
         }
     }
 
@@ -451,28 +1349,13 @@ namespace seqan {
     // anyway only very low values of gaussian kernel there
     void Observations::computeKDEs(String<__uint16> &truncCounts, AppOptions &options)
     {
-        resize(this->rpkms, length());
-
-        unsigned w_50 = options.bandwidth * 4;
-        // precompute kernel densities
-        String<double> kernelDensities;
-        resize(kernelDensities, w_50 + 1, 0.0);
+        String<double> kdes;
+        convolveKernel(kdes, truncCounts, options.kernelDensities);
 
-        // precompute kernel densities   -> K(d/h) store at position d
-        for (unsigned i = 0; i <= w_50; ++i)
-        {
-            if (options.gaussianKernel)
-                kernelDensities[i] = getGaussianKernelDensity((double)i/(double)options.bandwidth);
-            else if (options.epanechnikovKernel)
-                kernelDensities[i] = getEpanechnikovKernelDensity((double)i/(double)options.bandwidth);        
-        }
+        resize(this->rpkms, length());
         for (unsigned t = 0; t < length(); ++t)
         {
-            double kde = 0.0;
-            for (unsigned i = std::max((int)t - (int)w_50, (int)0); (i < length()) && (i <= t + w_50); ++i)  // inefficient if low genome coverage and not selected only for covered regions!!!
-            { 
-                kde += truncCounts[i] * kernelDensities[(unsigned)std::abs((int)t - (int)i)];
-            }
+            double kde = kdes[t];
             if (options.useLogRPKM)
             {
                 if ((kde/(double)options.bandwidth) > 0.0)
@@ -486,10 +1369,71 @@ namespace seqan {
     }
 
 
+    // state posterior probabilities of all covered intervals of one strand, in one contiguous buffer:
+    // interval i, position t, state k at (offsets[i] + t) * K + k
+    struct StatePosteriors {
+        String<double>      values;
+        String<__uint64>    offsets;        // first position of each interval, last entry: total no. of positions
+        unsigned            K;
+
+        StatePosteriors() : K(0) {}
+    };
+
+    void init(StatePosteriors &statePosteriors, String<Observations> &setObs, unsigned K)
+    {
+        statePosteriors.K = K;
+        resize(statePosteriors.offsets, length(setObs) + 1, Exact());
+        __uint64 offset = 0;
+        for (unsigned i = 0; i < length(setObs); ++i)
+        {
+            statePosteriors.offsets[i] = offset;
+            offset += setObs[i].length();
+        }
+        statePosteriors.offsets[length(setObs)] = offset;
+        clear(statePosteriors.values);
+        resize(statePosteriors.values, offset * K, Exact());
+    }
+
+    inline double & statePosterior(StatePosteriors &statePosteriors, unsigned i, unsigned t, unsigned k)
+    {
+        return statePosteriors.values[(statePosteriors.offsets[i] + t) * statePosteriors.K + k];
+    }
+
+    inline double statePosterior(StatePosteriors const &statePosteriors, unsigned i, unsigned t, unsigned k)
+    {
+        return statePosteriors.values[(statePosteriors.offsets[i] + t) * statePosteriors.K + k];
+    }
+
+    inline bool empty(StatePosteriors const &statePosteriors)
+    {
+        return empty(statePosteriors.values);
+    }
+
+    void clear(StatePosteriors &statePosteriors)
+    {
+        clear(statePosteriors.values);
+        clear(statePosteriors.offsets);
+    }
+
+    void append(StatePosteriors &statePosteriorsA, StatePosteriors const &statePosteriorsB)
+    {
+        if (empty(statePosteriorsA.offsets))
+        {
+            statePosteriorsA = statePosteriorsB;
+            return;
+        }
+        __uint64 offset = back(statePosteriorsA.offsets);
+        eraseBack(statePosteriorsA.offsets);
+        for (unsigned i = 0; i < length(statePosteriorsB.offsets); ++i)
+            appendValue(statePosteriorsA.offsets, offset + statePosteriorsB.offsets[i]);
+        append(statePosteriorsA.values, statePosteriorsB.values);
+    }
+
+
     struct Data {
         String<String<Observations> >               setObs;       // F/R:interval:t
         String<String<unsigned> >                   setPos;
-        String<String<String<String<double> > > >   statePosteriors;  // F/R:state:interval:t
+        String<StatePosteriors>                     statePosteriors;  // F/R: interval, t, state
         String<String<String<__uint8> > >           states;
     };
 